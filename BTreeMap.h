@@ -0,0 +1,844 @@
+#ifndef AISDI_MAPS_BTREEMAP_H
+#define AISDI_MAPS_BTREEMAP_H
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <tuple>
+
+namespace aisdi {
+
+	namespace btree {
+		// Target size of a node. A lookup touches one node per level and only the contiguous keys in it,
+		// so large nodes mean few levels without reading much more memory.
+		constexpr std::size_t nodeBytes = 1024;
+		constexpr std::size_t minSlots = 8;
+		// enough for any tree whose nodes hold at least minSlots / 2 entries
+		constexpr std::size_t maxHeight = 64;
+
+		// Index of the first of count entries for which pred is false, pred being true up to some index
+		// and false after it. The loop runs a fixed number of times for a given count and compiles to
+		// conditional moves, so a search costs no mispredicted branches.
+		template<typename Pred>
+		std::size_t partitionPoint(std::size_t count, Pred pred) {
+			if (count == 0)
+				return 0;
+			std::size_t base = 0;
+			while (count > 1) {
+				auto half = count / 2;
+				base = pred(base + half) ? base + half : base;
+				count -= half;
+			}
+			return base + pred(base);
+		}
+	}
+
+	// Ordered map with TreeMap's interface, stored as a B+ tree. Entries sit in sorted arrays in linked
+	// leaves, internal nodes hold only separator keys and children, so the tree is a few levels deep and
+	// iteration walks arrays. Iterators are invalidated by every insertion and removal, since entries
+	// move between nodes.
+	template<typename KeyType, typename ValueType, typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+	class BTreeMap {
+	public:
+		using key_type = KeyType;
+		using mapped_type = ValueType;
+		using value_type = std::pair<const key_type, mapped_type>;
+		using size_type = std::size_t;
+		using reference = value_type &;
+		using const_reference = const value_type &;
+		using allocator_type = Allocator;
+
+		class ConstIterator;
+
+		class Iterator;
+
+		using iterator = Iterator;
+		using const_iterator = ConstIterator;
+	private:
+		// Leaves hold the value_type objects the iterators hand out. Entries move when arrays shift by
+		// being constructed anew and destroyed, which copies the const key and moves the value.
+		using Slot = value_type;
+
+		// Small trivially copyable keys are also kept in an array of their own in every leaf, so the
+		// search in a leaf reads a cache line or two instead of striding over the values.
+		static constexpr bool leafKeys = std::is_trivially_copyable<key_type>::value && sizeof(key_type) <= 16;
+		static constexpr size_type leafEntryBytes = sizeof(Slot) + (leafKeys ? sizeof(key_type) : 0);
+		static constexpr size_type leafSlots = (btree::nodeBytes - 48) / leafEntryBytes > btree::minSlots
+																					 ? (btree::nodeBytes - 48) / leafEntryBytes : btree::minSlots;
+		static constexpr size_type internalSlots =
+				(btree::nodeBytes - 32) / (sizeof(key_type) + sizeof(void *)) > btree::minSlots
+				? (btree::nodeBytes - 32) / (sizeof(key_type) + sizeof(void *)) : btree::minSlots;
+		static constexpr size_type minLeaf = leafSlots / 2;
+		static constexpr size_type minInternal = (internalSlots - 1) / 2;
+
+		struct Internal;
+
+		struct NodeBase {
+			Internal *parent = nullptr;
+			unsigned position = 0; // index in parent->children
+			unsigned count = 0;
+			bool leaf;
+
+			explicit NodeBase(bool leaf) : leaf(leaf) {}
+		};
+
+		struct Leaf : NodeBase {
+			Leaf *previous = nullptr, *next = nullptr;
+			alignas(key_type) unsigned char keyStorage[leafKeys ? leafSlots * sizeof(key_type) : 1];
+			alignas(Slot) unsigned char storage[leafSlots * sizeof(Slot)];
+
+			Leaf() : NodeBase(true) {}
+
+			Slot *slots() {
+				return std::launder(reinterpret_cast<Slot *>(storage));
+			}
+
+			key_type *keys() {
+				return reinterpret_cast<key_type *>(keyStorage);
+			}
+		};
+
+		// count separator keys, keys[i] being the smallest key under children[i + 1]
+		struct Internal : NodeBase {
+			alignas(key_type) unsigned char storage[internalSlots * sizeof(key_type)];
+			NodeBase *children[internalSlots + 1];
+
+			Internal() : NodeBase(false) {}
+
+			key_type *keys() {
+				return std::launder(reinterpret_cast<key_type *>(storage));
+			}
+		};
+
+		using LeafAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Leaf>;
+		using LeafTraits = std::allocator_traits<LeafAllocator>;
+		using InternalAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Internal>;
+		using InternalTraits = std::allocator_traits<InternalAllocator>;
+
+		LeafAllocator leafAllocator;
+		InternalAllocator internalAllocator;
+		size_type size = 0;
+		NodeBase *root = nullptr;
+		Leaf *first = nullptr, *last = nullptr;
+
+		template<typename T>
+		static void moveItem(T *from, T *to) {
+			new(to) T(std::move(*from));
+			from->~T();
+		}
+
+		template<typename T>
+		static void moveItems(T *from, size_type n, T *to) {
+			if constexpr (std::is_trivially_copyable<T>::value) {
+				std::memcpy(static_cast<void *>(to), static_cast<const void *>(from), n * sizeof(T));
+				return;
+			}
+			for (size_type i = 0; i < n; i++)
+				moveItem(from + i, to + i);
+		}
+
+		// Moves the items behind index from up by one, leaving a gap at from.
+		template<typename T>
+		static void openGap(T *items, size_type from, size_type count) {
+			if constexpr (std::is_trivially_copyable<T>::value) {
+				std::memmove(static_cast<void *>(items + from + 1), static_cast<const void *>(items + from),
+										 (count - from) * sizeof(T));
+				return;
+			}
+			for (auto i = count; i > from; i--)
+				moveItem(items + i - 1, items + i);
+		}
+
+		// Moves the items behind the gap at index from down by one.
+		template<typename T>
+		static void closeGap(T *items, size_type from, size_type count) {
+			if constexpr (std::is_trivially_copyable<T>::value) {
+				std::memmove(static_cast<void *>(items + from), static_cast<const void *>(items + from + 1),
+										 (count - from - 1) * sizeof(T));
+				return;
+			}
+			for (auto i = from + 1; i < count; i++)
+				moveItem(items + i, items + i - 1);
+		}
+
+		// Entry moves within and between leaves, carrying the search keys along.
+		static void leafOpenGap(Leaf *leaf, size_type index) {
+			openGap(leaf->slots(), index, leaf->count);
+			if constexpr (leafKeys)
+				openGap(leaf->keys(), index, leaf->count);
+		}
+
+		static void leafCloseGap(Leaf *leaf, size_type index) {
+			closeGap(leaf->slots(), index, leaf->count);
+			if constexpr (leafKeys)
+				closeGap(leaf->keys(), index, leaf->count);
+		}
+
+		static void leafMove(Leaf *from, size_type index, Leaf *to, size_type toIndex, size_type n = 1) {
+			moveItems(from->slots() + index, n, to->slots() + toIndex);
+			if constexpr (leafKeys)
+				moveItems(from->keys() + index, n, to->keys() + toIndex);
+		}
+
+		static void setChild(Internal *node, size_type position, NodeBase *child) {
+			node->children[position] = child;
+			child->parent = node;
+			child->position = static_cast<unsigned>(position);
+		}
+
+		Leaf *createLeaf() {
+			auto leaf = LeafTraits::allocate(leafAllocator, 1);
+			LeafTraits::construct(leafAllocator, leaf);
+			return leaf;
+		}
+
+		Internal *createInternal() {
+			auto node = InternalTraits::allocate(internalAllocator, 1);
+			InternalTraits::construct(internalAllocator, node);
+			return node;
+		}
+
+		void destroyLeaf(Leaf *leaf) {
+			for (size_type i = 0; i < leaf->count; i++)
+				leaf->slots()[i].~Slot();
+			LeafTraits::destroy(leafAllocator, leaf);
+			LeafTraits::deallocate(leafAllocator, leaf, 1);
+		}
+
+		void destroyInternal(Internal *node) {
+			for (size_type i = 0; i < node->count; i++)
+				node->keys()[i].~key_type();
+			InternalTraits::destroy(internalAllocator, node);
+			InternalTraits::deallocate(internalAllocator, node, 1);
+		}
+
+		void deleteTree(NodeBase *node) {
+			if (node == nullptr)
+				return;
+			if (node->leaf) {
+				destroyLeaf(static_cast<Leaf *>(node));
+				return;
+			}
+			auto internal = static_cast<Internal *>(node);
+			for (size_type i = 0; i <= internal->count; i++)
+				deleteTree(internal->children[i]);
+			destroyInternal(internal);
+		}
+
+		void reset() {
+			deleteTree(root);
+			root = nullptr;
+			first = last = nullptr;
+			size = 0;
+		}
+
+		void copyFrom(const BTreeMap &other) {
+			try {
+				// appending in order takes the path that fills leaves completely
+				for (auto &&it : other)
+					tryEmplace(it.first, it.second);
+			} catch (...) {
+				reset();
+				throw;
+			}
+		}
+
+		void steal(BTreeMap &other) {
+			root = other.root;
+			first = other.first;
+			last = other.last;
+			size = other.size;
+			other.root = nullptr;
+			other.first = other.last = nullptr;
+			other.size = 0;
+		}
+
+		Leaf *findLeaf(const key_type &key) const {
+			auto node = root;
+			while (!node->leaf) {
+				auto internal = static_cast<Internal *>(node);
+				auto keys = internal->keys();
+				node = internal->children[btree::partitionPoint(internal->count, [&](size_type i) {
+					return !(key < keys[i]);
+				})];
+			}
+			return static_cast<Leaf *>(node);
+		}
+
+		static const key_type &leafKey(Leaf *leaf, size_type index) {
+			if constexpr (leafKeys)
+				return leaf->keys()[index];
+			return leaf->slots()[index].first;
+		}
+
+		static size_type lowerBound(Leaf *leaf, const key_type &key) {
+			return btree::partitionPoint(leaf->count, [&](size_type i) {
+				return leafKey(leaf, i) < key;
+			});
+		}
+
+		// The leaf and index holding key, or a null leaf.
+		std::pair<Leaf *, size_type> findSlot(const key_type &key) const {
+			if (root == nullptr)
+				return std::make_pair(nullptr, 0);
+			auto leaf = findLeaf(key);
+			auto index = lowerBound(leaf, key);
+			if (index < leaf->count && !(key < leafKey(leaf, index)))
+				return std::make_pair(leaf, index);
+			return std::make_pair(nullptr, 0);
+		}
+
+		// Inserts key with the child right of it at position of a node that has room.
+		static void insertKey(Internal *node, size_type position, const key_type &key, NodeBase *right) {
+			openGap(node->keys(), position, node->count);
+			new(node->keys() + position) key_type(key);
+			for (size_type i = node->count + 1; i > position + 1; i--)
+				setChild(node, i, node->children[i - 1]);
+			setChild(node, position + 1, right);
+			node->count++;
+		}
+
+		// Hangs right, split off left, into the parent of left. Full parents are split on the way up,
+		// taking their new siblings from spare. When append is set, right is the rightmost node of its
+		// level and the split leaves the left node full, so ascending insertion packs the tree.
+		void insertIntoParent(NodeBase *left, const key_type &key, NodeBase *right, Internal **&spare, bool append) {
+			auto parent = left->parent;
+			if (parent == nullptr) {
+				auto newRoot = *spare++;
+				new(newRoot->keys()) key_type(key);
+				newRoot->count = 1;
+				setChild(newRoot, 0, left);
+				setChild(newRoot, 1, right);
+				root = newRoot;
+				return;
+			}
+			size_type position = left->position;
+			if (parent->count < internalSlots) {
+				insertKey(parent, position, key, right);
+				return;
+			}
+			append = append && position == internalSlots;
+			auto sibling = *spare++;
+			size_type middle = append ? internalSlots - 1 : internalSlots / 2;
+			// keys[middle] moves up, the keys and children after it move to the sibling
+			auto keys = parent->keys();
+			key_type separator(std::move(keys[middle]));
+			keys[middle].~key_type();
+			moveItems(keys + middle + 1, internalSlots - middle - 1, sibling->keys());
+			for (auto i = middle + 1; i <= internalSlots; i++)
+				setChild(sibling, i - middle - 1, parent->children[i]);
+			sibling->count = static_cast<unsigned>(internalSlots - middle - 1);
+			parent->count = static_cast<unsigned>(middle);
+			if (position <= middle)
+				insertKey(parent, position, key, right);
+			else
+				insertKey(sibling, position - middle - 1, key, right);
+			insertIntoParent(parent, separator, sibling, spare, append);
+		}
+
+		// Splits the full leaf. Every node the split needs is allocated before the tree is touched, so a
+		// failed allocation leaves it unchanged. Returns the new right leaf.
+		Leaf *splitLeaf(Leaf *leaf, bool append) {
+			size_type needed = 0;
+			auto parent = leaf->parent;
+			while (parent != nullptr && parent->count == internalSlots) {
+				needed++;
+				parent = parent->parent;
+			}
+			if (parent == nullptr)
+				needed++;
+			Internal *spare[btree::maxHeight];
+			size_type allocated = 0;
+			Leaf *right = nullptr;
+			try {
+				right = createLeaf();
+				for (; allocated < needed; allocated++)
+					spare[allocated] = createInternal();
+			} catch (...) {
+				for (size_type i = 0; i < allocated; i++)
+					destroyInternal(spare[i]);
+				if (right != nullptr)
+					destroyLeaf(right);
+				throw;
+			}
+			size_type keep = append ? leafSlots - 1 : leafSlots - leafSlots / 2;
+			leafMove(leaf, keep, right, 0, leaf->count - keep);
+			right->count = static_cast<unsigned>(leaf->count - keep);
+			leaf->count = static_cast<unsigned>(keep);
+			right->next = leaf->next;
+			right->previous = leaf;
+			if (leaf->next != nullptr)
+				leaf->next->previous = right;
+			else
+				last = right;
+			leaf->next = right;
+			auto next = spare;
+			insertIntoParent(leaf, right->slots()[0].first, right, next, append);
+			return right;
+		}
+
+		template<typename... Args>
+		iterator insertAt(Leaf *leaf, size_type index, Args &&... args) {
+			if (leaf->count == leafSlots) {
+				bool append = leaf == last && index == leafSlots;
+				auto right = splitLeaf(leaf, append);
+				if (index > leaf->count) {
+					index -= leaf->count;
+					leaf = right;
+				}
+			}
+			auto slots = leaf->slots();
+			openGap(slots, index, leaf->count);
+			try {
+				new(slots + index) Slot(std::forward<Args>(args)...);
+			} catch (...) {
+				closeGap(slots, index, leaf->count + 1);
+				throw;
+			}
+			if constexpr (leafKeys) {
+				openGap(leaf->keys(), index, leaf->count);
+				leaf->keys()[index] = slots[index].first;
+			}
+			leaf->count++;
+			size++;
+			return iterator(const_iterator(this, leaf, index));
+		}
+
+		// Removes the key slot at position, which was already destroyed or moved from, and the child
+		// right of it.
+		void unlinkChild(Internal *node, size_type position) {
+			closeGap(node->keys(), position, node->count);
+			for (auto i = position + 1; i < node->count; i++)
+				setChild(node, i, node->children[i + 1]);
+			node->count--;
+			if (node == root) {
+				if (node->count == 0) {
+					root = node->children[0];
+					root->parent = nullptr;
+					root->position = 0;
+					destroyInternal(node);
+				}
+				return;
+			}
+			if (node->count < minInternal)
+				rebalanceInternal(node);
+		}
+
+		void mergeLeaves(Leaf *left, Leaf *right) {
+			leafMove(right, 0, left, left->count, right->count);
+			left->count += right->count;
+			right->count = 0;
+			left->next = right->next;
+			if (right->next != nullptr)
+				right->next->previous = left;
+			else
+				last = left;
+			auto parent = left->parent;
+			size_type position = left->position;
+			destroyLeaf(right);
+			parent->keys()[position].~key_type();
+			unlinkChild(parent, position);
+		}
+
+		void mergeInternals(Internal *left, Internal *right) {
+			auto parent = left->parent;
+			size_type position = left->position;
+			moveItem(parent->keys() + position, left->keys() + left->count);
+			moveItems(right->keys(), right->count, left->keys() + left->count + 1);
+			for (size_type i = 0; i <= right->count; i++)
+				setChild(left, left->count + 1 + i, right->children[i]);
+			left->count += right->count + 1;
+			right->count = 0;
+			destroyInternal(right);
+			unlinkChild(parent, position);
+		}
+
+		// Refills a leaf that fell below half from a sibling, or merges the two.
+		void rebalanceLeaf(Leaf *leaf) {
+			auto parent = leaf->parent;
+			size_type position = leaf->position;
+			if (position > 0) {
+				auto left = static_cast<Leaf *>(parent->children[position - 1]);
+				if (left->count <= minLeaf) {
+					mergeLeaves(left, leaf);
+					return;
+				}
+				leafOpenGap(leaf, 0);
+				leafMove(left, left->count - 1, leaf, 0);
+				left->count--;
+				leaf->count++;
+				parent->keys()[position - 1] = leaf->slots()[0].first;
+				return;
+			}
+			auto right = static_cast<Leaf *>(parent->children[position + 1]);
+			if (right->count <= minLeaf) {
+				mergeLeaves(leaf, right);
+				return;
+			}
+			leafMove(right, 0, leaf, leaf->count);
+			leafCloseGap(right, 0);
+			right->count--;
+			leaf->count++;
+			parent->keys()[position] = right->slots()[0].first;
+		}
+
+		// Same for internal nodes, rotating keys through the parent.
+		void rebalanceInternal(Internal *node) {
+			auto parent = node->parent;
+			size_type position = node->position;
+			if (position > 0) {
+				auto left = static_cast<Internal *>(parent->children[position - 1]);
+				if (left->count <= minInternal) {
+					mergeInternals(left, node);
+					return;
+				}
+				openGap(node->keys(), 0, node->count);
+				moveItem(parent->keys() + position - 1, node->keys());
+				moveItem(left->keys() + left->count - 1, parent->keys() + position - 1);
+				for (size_type i = node->count + 1; i > 0; i--)
+					setChild(node, i, node->children[i - 1]);
+				setChild(node, 0, left->children[left->count]);
+				left->count--;
+				node->count++;
+				return;
+			}
+			auto right = static_cast<Internal *>(parent->children[position + 1]);
+			if (right->count <= minInternal) {
+				mergeInternals(node, right);
+				return;
+			}
+			moveItem(parent->keys() + position, node->keys() + node->count);
+			setChild(node, node->count + 1, right->children[0]);
+			moveItem(right->keys(), parent->keys() + position);
+			closeGap(right->keys(), 0, right->count);
+			for (size_type i = 0; i < right->count; i++)
+				setChild(right, i, right->children[i + 1]);
+			right->count--;
+			node->count++;
+		}
+
+		void eraseAt(Leaf *leaf, size_type index) {
+			leaf->slots()[index].~Slot();
+			leafCloseGap(leaf, index);
+			leaf->count--;
+			size--;
+			if (leaf == root) {
+				if (leaf->count == 0)
+					reset();
+				return;
+			}
+			if (leaf->count < minLeaf)
+				rebalanceLeaf(leaf);
+		}
+
+		template<typename K, typename... Args>
+		std::pair<iterator, bool> tryEmplace(K &&key, Args &&... args) {
+			if (root == nullptr)
+				root = first = last = createLeaf();
+			auto leaf = findLeaf(key);
+			auto index = lowerBound(leaf, key);
+			if (index < leaf->count && !(key < leafKey(leaf, index)))
+				return std::make_pair(iterator(const_iterator(this, leaf, index)), false);
+			return std::make_pair(insertAt(leaf, index, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+																		 std::forward_as_tuple(std::forward<Args>(args)...)), true);
+		}
+
+		template<typename K, typename M>
+		std::pair<iterator, bool> insertOrAssign(K &&key, M &&obj) {
+			auto result = tryEmplace(std::forward<K>(key), std::forward<M>(obj));
+			// obj is only consumed when a new entry was built from it
+			if (!result.second)
+				result.first->second = std::forward<M>(obj);
+			return result;
+		}
+
+	public:
+		BTreeMap() = default;
+
+		explicit BTreeMap(const Allocator &allocator) : leafAllocator(allocator), internalAllocator(allocator) {}
+
+		~BTreeMap() {
+			deleteTree(root);
+		}
+
+		BTreeMap(std::initializer_list<value_type> list) {
+			for (auto &&it : list) {
+				(*this)[it.first] = it.second;
+			}
+		}
+
+		BTreeMap(const BTreeMap &other)
+				: leafAllocator(LeafTraits::select_on_container_copy_construction(other.leafAllocator)),
+					internalAllocator(leafAllocator) {
+			copyFrom(other);
+		}
+
+		BTreeMap(BTreeMap &&other) : leafAllocator(other.leafAllocator), internalAllocator(other.internalAllocator) {
+			steal(other);
+		}
+
+		BTreeMap &operator=(const BTreeMap &other) {
+			if (this != &other) {
+				reset();
+				copyFrom(other);
+			}
+			return *this;
+		}
+
+		BTreeMap &operator=(BTreeMap &&other) {
+			if (this == &other)
+				return *this;
+			reset();
+			leafAllocator = other.leafAllocator;
+			internalAllocator = other.internalAllocator;
+			steal(other);
+			return *this;
+		}
+
+		allocator_type get_allocator() const {
+			return allocator_type(leafAllocator);
+		}
+
+		bool isEmpty() const {
+			return size == 0;
+		}
+
+		mapped_type &operator[](const key_type &key) {
+			return tryEmplace(key).first->second;
+		}
+
+		mapped_type &operator[](key_type &&key) {
+			return tryEmplace(std::move(key)).first->second;
+		}
+
+		// The entry is built first since the key is only known afterwards.
+		template<typename... Args>
+		std::pair<iterator, bool> emplace(Args &&... args) {
+			std::pair<key_type, mapped_type> entry(std::forward<Args>(args)...);
+			return tryEmplace(std::move(entry.first), std::move(entry.second));
+		}
+
+		// Constructs the value from args only when key is absent; otherwise args are left untouched.
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+			return tryEmplace(key, std::forward<Args>(args)...);
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+			return tryEmplace(std::move(key), std::forward<Args>(args)...);
+		}
+
+		template<typename M>
+		std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+			return insertOrAssign(key, std::forward<M>(obj));
+		}
+
+		template<typename M>
+		std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+			return insertOrAssign(std::move(key), std::forward<M>(obj));
+		}
+
+		const mapped_type &valueOf(const key_type &key) const {
+			auto found = findSlot(key);
+			if (found.first == nullptr)
+				throw std::out_of_range("valueof");
+			return found.first->slots()[found.second].second;
+		}
+
+		mapped_type &valueOf(const key_type &key) {
+			auto found = findSlot(key);
+			if (found.first == nullptr)
+				throw std::out_of_range("valueof");
+			return found.first->slots()[found.second].second;
+		}
+
+		const_iterator find(const key_type &key) const {
+			auto found = findSlot(key);
+			return const_iterator(this, found.first, found.second);
+		}
+
+		iterator find(const key_type &key) {
+			auto found = findSlot(key);
+			return iterator(const_iterator(this, found.first, found.second));
+		}
+
+		void remove(const key_type &key) {
+			remove(find(key));
+		}
+
+		void remove(const const_iterator &it) {
+			if (it.leaf == nullptr || it.tree != this)
+				throw std::out_of_range("remove");
+			eraseAt(it.leaf, it.index);
+		}
+
+		size_type getSize() const {
+			return size;
+		}
+
+		bool operator==(const BTreeMap &other) const {
+			if (size != other.size) return false;
+			auto it = this->begin();
+			for (auto it2 = other.begin(); it2 != other.end(); ++it2) {
+				if ((it->first != it2->first) || (it->second != it2->second))
+					return false;
+				++it;
+			}
+			return true;
+		}
+
+		bool operator!=(const BTreeMap &other) const {
+			return !(*this == other);
+		}
+
+		iterator begin() {
+			return iterator(cbegin());
+		}
+
+		iterator end() {
+			return iterator(cend());
+		}
+
+		const_iterator cbegin() const {
+			return const_iterator(this, size == 0 ? nullptr : first, 0);
+		}
+
+		const_iterator cend() const {
+			return const_iterator(this, nullptr, 0);
+		}
+
+		const_iterator begin() const {
+			return cbegin();
+		}
+
+		const_iterator end() const {
+			return cend();
+		}
+	};
+
+	template<typename KeyType, typename ValueType, typename Allocator>
+	class BTreeMap<KeyType, ValueType, Allocator>::ConstIterator {
+	public:
+		using reference = typename BTreeMap::const_reference;
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = typename BTreeMap::value_type;
+		using pointer = const typename BTreeMap::value_type *;
+
+	private:
+		friend class BTreeMap;
+
+		const BTreeMap *tree = nullptr;
+		Leaf *leaf = nullptr; // nullptr at the end
+		size_type index = 0;
+
+	public:
+		explicit ConstIterator() {}
+
+		ConstIterator(const BTreeMap *tree, Leaf *leaf, size_type index) : tree(tree), leaf(leaf), index(index) {}
+
+		ConstIterator &operator++() {
+			if (leaf == nullptr)
+				throw std::out_of_range("++op");
+			if (++index == leaf->count) {
+				leaf = leaf->next;
+				index = 0;
+			}
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			auto tmp = *this;
+			++(*this);
+			return tmp;
+		}
+
+		ConstIterator &operator--() {
+			if (leaf == nullptr) {
+				if (tree == nullptr || tree->size == 0) throw std::out_of_range("op--");
+				leaf = tree->last;
+				index = leaf->count;
+			} else if (index == 0) {
+				if (leaf->previous == nullptr) throw std::out_of_range("op--");
+				leaf = leaf->previous;
+				index = leaf->count;
+			}
+			index--;
+			return *this;
+		}
+
+		ConstIterator operator--(int) {
+			auto tmp = *this;
+			--(*this);
+			return tmp;
+		}
+
+		reference operator*() const {
+			if (leaf == nullptr)
+				throw std::out_of_range("op*");
+			return leaf->slots()[index];
+		}
+
+		pointer operator->() const {
+			return &this->operator*();
+		}
+
+		bool operator==(const ConstIterator &other) const {
+			return leaf == other.leaf && index == other.index;
+		}
+
+		bool operator!=(const ConstIterator &other) const {
+			return !(*this == other);
+		}
+	};
+
+	template<typename KeyType, typename ValueType, typename Allocator>
+	class BTreeMap<KeyType, ValueType, Allocator>::Iterator : public BTreeMap<KeyType, ValueType, Allocator>::ConstIterator {
+	public:
+		using reference = typename BTreeMap::reference;
+		using pointer = typename BTreeMap::value_type *;
+
+		explicit Iterator() {}
+
+		Iterator(const ConstIterator &other)
+				: ConstIterator(other) {}
+
+		Iterator &operator++() {
+			ConstIterator::operator++();
+			return *this;
+		}
+
+		Iterator operator++(int) {
+			auto result = *this;
+			ConstIterator::operator++();
+			return result;
+		}
+
+		Iterator &operator--() {
+			ConstIterator::operator--();
+			return *this;
+		}
+
+		Iterator operator--(int) {
+			auto result = *this;
+			ConstIterator::operator--();
+			return result;
+		}
+
+		pointer operator->() const {
+			return &this->operator*();
+		}
+
+		reference operator*() const {
+			return const_cast<reference>(ConstIterator::operator*());
+		}
+	};
+
+}
+
+#endif /* AISDI_MAPS_BTREEMAP_H */
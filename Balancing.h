@@ -0,0 +1,300 @@
+#ifndef AISDI_MAPS_BALANCING_H
+#define AISDI_MAPS_BALANCING_H
+
+#include <cstddef>
+
+namespace aisdi {
+
+	// Balancing policies of TreeMap. A policy keeps its per node state in the two tag bits of a node and
+	// restores balance with the rotations of the tree after a node is linked in or taken out.
+	// Joins of whole trees are guided by a rank: the rank of every subtree follows from the rank of its
+	// parent, and trees of equal rank are joined below a new root.
+	// The tree is passed in, so a policy only has static members and is a friend of TreeMap.
+
+	// Red-black trees: at most 2 log n levels, at most three rotations per update.
+	// The tag is the colour, 0 = black and 1 = red, and the rank the black height.
+	struct RedBlackPolicy {
+		template<typename Node>
+		static bool isBlack(const Node *node) {
+			return node == nullptr || node->getTag() == 0;
+		}
+
+		// A node about to be linked in with subtrees of the given ranks.
+		template<typename Node>
+		static void initNode(Node *node, std::size_t, std::size_t) {
+			node->setTag(1);
+		}
+
+		// A node of a tree built from sorted keys, where all levels but the deepest are full.
+		template<typename Node>
+		static void initBuilt(Node *node, bool deepest, std::size_t, std::size_t) {
+			node->setTag(deepest);
+		}
+
+		// A red root may always be made black.
+		template<typename Node>
+		static void normalizeRoot(Node *root, std::size_t &rank) {
+			if (root != nullptr && root->getTag() == 1) {
+				root->setTag(0);
+				rank++;
+			}
+		}
+
+		template<typename Node>
+		static std::size_t rankOf(const Node *node) {
+			std::size_t height = 0;
+			for (; node != nullptr; node = node->left)
+				height += node->getTag() == 0;
+			return height;
+		}
+
+		template<typename Node>
+		static std::size_t childRank(const Node *node, std::size_t rank, bool) {
+			return rank - (node->getTag() == 0);
+		}
+
+		// Whether a join goes on down past node, of the given rank, to hang a tree of rank target.
+		template<typename Node>
+		static bool descend(const Node *node, std::size_t rank, std::size_t target) {
+			return rank > target || (node != nullptr && node->getTag() == 1);
+		}
+
+		// Returns whether it turned a red root black, which adds one to the black height of the tree.
+		template<typename Tree, typename Node>
+		static bool afterInsert(Tree &tree, Node *z) {
+			auto y = z;
+			while (z->getParent()->getTag() == 1) {
+				if (z->getParent() == z->getParent()->getParent()->left) {
+					y = z->getParent()->getParent()->right;
+					if ((y != nullptr) && (y->getTag() == 1)) {
+						z->getParent()->setTag(0);
+						y->setTag(0);
+						z->getParent()->getParent()->setTag(1);
+						z = z->getParent()->getParent();
+					} else {
+						if (z == z->getParent()->right) {
+							z = z->getParent();
+							tree.rotateLeft(z);
+						}
+						z->getParent()->setTag(0);
+						z->getParent()->getParent()->setTag(1);
+						tree.rotateRight(z->getParent()->getParent());
+					}
+				} else {
+					y = z->getParent()->getParent()->left;
+					if ((y != nullptr) && (y->getTag() == 1)) {
+						z->getParent()->setTag(0);
+						y->setTag(0);
+						z->getParent()->getParent()->setTag(1);
+						z = z->getParent()->getParent();
+					} else {
+						if (z == z->getParent()->left) {
+							z = z->getParent();
+							tree.rotateRight(z);
+						}
+						z->getParent()->setTag(0);
+						z->getParent()->getParent()->setTag(1);
+						tree.rotateLeft(z->getParent()->getParent());
+					}
+				}
+			}
+			bool grew = tree.root->getTag() == 1;
+			tree.root->setTag(0);
+			return grew;
+		}
+
+		// x took the place of a node with the given tag and may be a null leaf, so its parent is passed
+		// separately. The sibling of a black x is never null, which tells the side of x.
+		template<typename Tree, typename Node>
+		static void afterRemove(Tree &tree, Node *x, Node *xParent, bool, unsigned removedTag) {
+			if (removedTag == 1)
+				return;
+			Node * w;
+			while ((x != tree.root) && isBlack(x)){
+				if (x == xParent->left){
+					w = xParent->right;
+					if (w->getTag() == 1){
+						w->setTag(0);
+						xParent->setTag(1);
+						tree.rotateLeft(xParent);
+						w = xParent->right;
+					}
+					if (isBlack(w->left) && isBlack(w->right)) {
+						w->setTag(1);
+						x = xParent;
+						xParent = x->getParent();
+					} else {
+						if (isBlack(w->right)) {
+							w->left->setTag(0);
+							w->setTag(1);
+							tree.rotateRight(w);
+							w = xParent->right;
+						}
+						w->setTag(xParent->getTag());
+						xParent->setTag(0);
+						w->right->setTag(0);
+						tree.rotateLeft(xParent);
+						x = tree.root;
+					}
+				} else {
+					w = xParent->left;
+					if (w->getTag() == 1){
+						w->setTag(0);
+						xParent->setTag(1);
+						tree.rotateRight(xParent);
+						w = xParent->left;
+					}
+					if (isBlack(w->right) && isBlack(w->left)) {
+						w->setTag(1);
+						x = xParent;
+						xParent = x->getParent();
+					} else {
+						if (isBlack(w->left)) {
+							w->right->setTag(0);
+							w->setTag(1);
+							tree.rotateLeft(w);
+							w = xParent->left;
+						}
+						w->setTag(xParent->getTag());
+						xParent->setTag(0);
+						w->left->setTag(0);
+						tree.rotateRight(xParent);
+						x = tree.root;
+					}
+				}
+			}
+			if (x != nullptr)
+				x->setTag(0);
+		}
+	};
+
+	// AVL trees: at most 1.44 log n levels, so lookups are shallower, for more rotations on updates.
+	// The tag is the balance, the height of the right subtree less that of the left one, plus one,
+	// and the rank the height.
+	struct AvlPolicy {
+		template<typename Node>
+		static int balance(const Node *node) {
+			return static_cast<int>(node->getTag()) - 1;
+		}
+
+		template<typename Node>
+		static void setBalance(Node *node, int balance) {
+			node->setTag(static_cast<unsigned>(balance + 1));
+		}
+
+		template<typename Node>
+		static void initNode(Node *node, std::size_t leftHeight, std::size_t rightHeight) {
+			setBalance(node, static_cast<int>(rightHeight) - static_cast<int>(leftHeight));
+		}
+
+		template<typename Node>
+		static void initBuilt(Node *node, bool, std::size_t leftHeight, std::size_t rightHeight) {
+			initNode(node, leftHeight, rightHeight);
+		}
+
+		template<typename Node>
+		static void normalizeRoot(Node *, std::size_t &) {
+		}
+
+		template<typename Node>
+		static std::size_t rankOf(const Node *node) {
+			std::size_t height = 0;
+			for (; node != nullptr; node = balance(node) > 0 ? node->right : node->left)
+				height++;
+			return height;
+		}
+
+		template<typename Node>
+		static std::size_t childRank(const Node *node, std::size_t rank, bool left) {
+			return rank - 1 - (balance(node) == (left ? 1 : -1));
+		}
+
+		template<typename Node>
+		static bool descend(const Node *, std::size_t rank, std::size_t target) {
+			return rank > target + 1;
+		}
+
+		// Rotates node, two levels heavier on the right (rightHeavy) or the left, back into balance and
+		// returns the new root of the subtree. The subtree is one level lower than before unless the
+		// heavy child was balanced.
+		template<typename Tree, typename Node>
+		static Node *rebalance(Tree &tree, Node *node, bool rightHeavy, bool &lower) {
+			int side = rightHeavy ? 1 : -1;
+			auto child = rightHeavy ? node->right : node->left;
+			auto childBalance = balance(child);
+			if (childBalance == -side) {
+				auto grandchild = rightHeavy ? child->left : child->right;
+				auto grandchildBalance = balance(grandchild);
+				if (rightHeavy) {
+					tree.rotateRight(child);
+					tree.rotateLeft(node);
+				} else {
+					tree.rotateLeft(child);
+					tree.rotateRight(node);
+				}
+				setBalance(node, grandchildBalance == side ? -side : 0);
+				setBalance(child, grandchildBalance == -side ? side : 0);
+				setBalance(grandchild, 0);
+				lower = true;
+				return grandchild;
+			}
+			if (rightHeavy)
+				tree.rotateLeft(node);
+			else
+				tree.rotateRight(node);
+			setBalance(node, childBalance == 0 ? side : 0);
+			setBalance(child, childBalance == 0 ? -side : 0);
+			lower = childBalance != 0;
+			return child;
+		}
+
+		// The subtree of node has grown by one level. Returns whether the whole tree has. A join grows a
+		// subtree whose root may be balanced, so that case is handled as well as a new leaf.
+		template<typename Tree, typename Node>
+		static bool afterInsert(Tree &tree, Node *node) {
+			for (auto parent = node->getParent(); parent != &tree.sentinel; parent = node->getParent()) {
+				int side = node == parent->left ? -1 : 1;
+				auto parentBalance = balance(parent);
+				if (parentBalance == -side) {
+					setBalance(parent, 0);
+					return false;
+				}
+				if (parentBalance == 0) {
+					setBalance(parent, side);
+					node = parent;
+					continue;
+				}
+				bool lower;
+				node = rebalance(tree, parent, side > 0, lower);
+				if (lower)
+					return false;
+			}
+			return true;
+		}
+
+		// The subtree on the fromLeft side of parent has lost one level.
+		template<typename Tree, typename Node>
+		static void afterRemove(Tree &tree, Node *, Node *parent, bool fromLeft, unsigned) {
+			while (parent != &tree.sentinel) {
+				int side = fromLeft ? -1 : 1;
+				auto parentBalance = balance(parent);
+				auto node = parent;
+				if (parentBalance == side)
+					setBalance(parent, 0);
+				else if (parentBalance == 0) {
+					setBalance(parent, -side);
+					return;
+				} else {
+					bool lower;
+					node = rebalance(tree, parent, side < 0, lower);
+					if (!lower)
+						return;
+				}
+				parent = node->getParent();
+				fromLeft = node == parent->left;
+			}
+		}
+	};
+}
+
+#endif /* AISDI_MAPS_BALANCING_H */
@@ -0,0 +1,312 @@
+#ifndef AISDI_MAPS_CONCURRENTHASHMAP_H
+#define AISDI_MAPS_CONCURRENTHASHMAP_H
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+
+#include "HashMap.h"
+#include "Hashing.h"
+
+namespace aisdi
+{
+
+// HashMap that can be used from many threads at once. Keys are spread over independent HashMap
+// segments, each behind its own reader-writer lock, so threads only contend when they touch the same
+// segment and readers of a segment never block each other.
+// Every operation is atomic with respect to its key. Nothing hands out references or iterators into
+// the map, as they would outlive the lock: reads return copies, and in-place work goes through
+// visit, update and compute, whose callbacks run under the segment lock and must not call back
+// into the map.
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+		typename KeyEqual = std::equal_to<KeyType>,
+		typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+		typename BucketPolicy = PrimeModuloPolicy>
+class ConcurrentHashMap
+{
+public:
+  using key_type = KeyType;
+  using mapped_type = ValueType;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  using segment_type = HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator, BucketPolicy>;
+private:
+	// a segment per cache line, so the locks of neighbouring segments do not share one
+	struct alignas(64) Segment
+	{
+		mutable std::shared_mutex lock;
+		segment_type map;
+
+		// Every segment gets its own copy of the allocator, as stateful allocators like SlabAllocator
+		// must not be shared between threads.
+		Segment(const Hash& hash, const KeyEqual& equal, const Allocator& allocator)
+			: map(0, hash, equal, std::allocator_traits<Allocator>::select_on_container_copy_construction(allocator))
+		{}
+	};
+
+	using ReadLock = std::shared_lock<std::shared_mutex>;
+	using WriteLock = std::unique_lock<std::shared_mutex>;
+
+	static constexpr std::size_t segmentSeed = static_cast<std::size_t>(0x9e3779b97f4a7c15ULL);
+
+	Hash hashFunction;
+	size_type segmentCount;
+	std::unique_ptr<std::unique_ptr<Segment>[]> segments;
+
+	static size_type defaultSegmentCount()
+	{
+		// a few segments per core keep the chance that two threads collide low
+		auto threads = std::thread::hardware_concurrency();
+		return 4 * (threads == 0 ? 4 : threads);
+	}
+	// The bucket index of a segment comes from the low bits (PowerOfTwoPolicy) or the high bits
+	// (FastRangePolicy) of the hash or of mix(hash), so any bits of those would leave the keys of a
+	// segment sharing some bucket bits and most of its buckets empty. The segment is picked by the hash
+	// mixed once more with a seed of its own instead, which no bucket policy sees.
+	Segment& segmentFor(const key_type& key) const
+	{
+		auto hash = hashing::mix(hashFunction(key) ^ segmentSeed);
+		return *segments[hash & (segmentCount - 1)];
+	}
+public:
+  explicit ConcurrentHashMap(size_type segments = defaultSegmentCount(), const Hash& hash = Hash(),
+		const KeyEqual& equal = KeyEqual(), const Allocator& allocator = Allocator())
+		: hashFunction(hash), segmentCount(1)
+  {
+		while(segmentCount < segments)
+			segmentCount *= 2;
+		this->segments.reset(new std::unique_ptr<Segment>[segmentCount]);
+		for(size_type i = 0; i < segmentCount; i++)
+			this->segments[i].reset(new Segment(hash, equal, allocator));
+  }
+
+  ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+  ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+  size_type segment_count() const
+  {
+		return segmentCount;
+  }
+
+  hasher hash_function() const
+  {
+		return hashFunction;
+  }
+
+  // Sum of the segment sizes, each read under its lock. Exact only while no thread is writing.
+  size_type getSize() const
+  {
+		size_type size = 0;
+		for(size_type i = 0; i < segmentCount; i++)
+		{
+			ReadLock lock(segments[i]->lock);
+			size += segments[i]->map.getSize();
+		}
+		return size;
+  }
+
+  bool isEmpty() const
+  {
+		return getSize() == 0;
+  }
+
+  // Reserves room for elements spread evenly over the segments.
+  void reserve(size_type elements)
+  {
+		for(size_type i = 0; i < segmentCount; i++)
+		{
+			WriteLock lock(segments[i]->lock);
+			segments[i]->map.reserve(elements / segmentCount + 1);
+		}
+  }
+
+  std::optional<mapped_type> find(const key_type& key) const
+  {
+		auto &segment = segmentFor(key);
+		ReadLock lock(segment.lock);
+		auto it = segment.map.find(key);
+		if(it == segment.map.end())
+			return std::nullopt;
+		return it->second;
+  }
+
+  mapped_type valueOf(const key_type& key) const
+  {
+		auto value = find(key);
+		if(!value)
+			throw std::out_of_range("valueOf");
+		return *std::move(value);
+  }
+
+  bool contains(const key_type& key) const
+  {
+		auto &segment = segmentFor(key);
+		ReadLock lock(segment.lock);
+		return segment.map.find(key) != segment.map.end();
+  }
+
+  // Calls f(const mapped_type&) under the read lock without copying the value. Returns false when
+  // the key is absent.
+  template <typename F>
+  bool visit(const key_type& key, F f) const
+  {
+		auto &segment = segmentFor(key);
+		ReadLock lock(segment.lock);
+		auto it = segment.map.find(key);
+		if(it == segment.map.end())
+			return false;
+		f(static_cast<const mapped_type&>(it->second));
+		return true;
+  }
+
+  // Returns true when the key was inserted, false when an existing value was assigned.
+  template <typename M>
+  bool insert_or_assign(const key_type& key, M&& obj)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		return segment.map.insert_or_assign(key, std::forward<M>(obj)).second;
+  }
+
+  template <typename M>
+  bool insert_or_assign(key_type&& key, M&& obj)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		return segment.map.insert_or_assign(std::move(key), std::forward<M>(obj)).second;
+  }
+
+  // Inserts only when the key is absent. Returns true when it inserted.
+  template <typename... Args>
+  bool try_emplace(const key_type& key, Args&&... args)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		return segment.map.try_emplace(key, std::forward<Args>(args)...).second;
+  }
+
+  template <typename... Args>
+  bool try_emplace(key_type&& key, Args&&... args)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		return segment.map.try_emplace(std::move(key), std::forward<Args>(args)...).second;
+  }
+
+  size_type erase(const key_type& key)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		return segment.map.erase(key);
+  }
+
+  void remove(const key_type& key)
+  {
+		if(erase(key) == 0)
+			throw std::out_of_range("remove");
+  }
+
+  // Calls f(mapped_type&) under the write lock when the key is present. Returns false when it is not.
+  template <typename F>
+  bool update(const key_type& key, F f)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		auto it = segment.map.find(key);
+		if(it == segment.map.end())
+			return false;
+		f(it->second);
+		return true;
+  }
+
+  // Read-modify-write of one key under the write lock. f gets a std::optional<mapped_type>& holding
+  // the current value, or empty when the key is absent. When f leaves it engaged the value is stored,
+  // when f resets it the key is erased. The value is moved in and out, never copied.
+  // If f throws, the entry gets back the value as f left it, so a value f had not changed yet is kept,
+  // and the exception propagates. Returns whether the key is present afterwards.
+  template <typename F>
+  bool compute(const key_type& key, F f)
+  {
+		auto &segment = segmentFor(key);
+		WriteLock lock(segment.lock);
+		auto it = segment.map.find(key);
+		std::optional<mapped_type> value;
+		if(it != segment.map.end())
+			value.emplace(std::move(it->second));
+		try
+		{
+			f(value);
+		}
+		catch(...)
+		{
+			if(it != segment.map.end())
+			{
+				if(value)
+					it->second = std::move(*value);
+				else
+					segment.map.erase(it);
+			}
+			throw;
+		}
+		if(!value)
+		{
+			if(it != segment.map.end())
+				segment.map.erase(it);
+			return false;
+		}
+		if(it != segment.map.end())
+			it->second = std::move(*value);
+		else
+			segment.map.try_emplace(key, std::move(*value));
+		return true;
+  }
+
+  // Calls f(const value_type&) for every element, holding the read lock of one segment at a time.
+  // Other threads keep working on the remaining segments meanwhile, so the visit is not a snapshot
+  // of the whole map: an element inserted or erased concurrently may or may not be seen.
+  template <typename F>
+  void for_each(F f) const
+  {
+		for(size_type i = 0; i < segmentCount; i++)
+		{
+			ReadLock lock(segments[i]->lock);
+			for(auto &&it: segments[i]->map)
+				f(static_cast<const value_type&>(it));
+		}
+  }
+
+  // Like for_each with the write lock, f gets value_type& and may modify the mapped values.
+  template <typename F>
+  void update_each(F f)
+  {
+		for(size_type i = 0; i < segmentCount; i++)
+		{
+			WriteLock lock(segments[i]->lock);
+			for(auto &&it: segments[i]->map)
+				f(it);
+		}
+  }
+
+  // Empties the segments one after another.
+  void clear()
+  {
+		for(size_type i = 0; i < segmentCount; i++)
+		{
+			WriteLock lock(segments[i]->lock);
+			segments[i]->map.clear();
+		}
+  }
+};
+
+}
+
+#endif /* AISDI_MAPS_CONCURRENTHASHMAP_H */
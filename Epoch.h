@@ -0,0 +1,137 @@
+#ifndef AISDI_MAPS_EPOCH_H
+#define AISDI_MAPS_EPOCH_H
+#include <atomic>
+#include <cstdint>
+
+namespace aisdi
+{
+
+// Epoch-based reclamation for containers whose readers take no locks. A reader announces the epoch
+// it started in for the length of a Guard, writers unlink nodes, retire them with the epoch current
+// after the unlink, and free them once every announced epoch is newer.
+// Entering a guard is a plain store to a cache line owned by the thread and a fence, without any
+// atomic read-modify-write. Only writers advance the epoch.
+namespace epoch
+{
+	// State of one thread, alone on its cache line. active is 0 outside of a guard.
+	struct alignas(64) Record
+	{
+		std::atomic<std::uint64_t> active{0};
+		std::atomic<bool> inUse{true};
+		Record *next = nullptr;
+		unsigned depth = 0;
+	};
+
+	// Records are kept for the lifetime of the program and reused by threads started later.
+	class Domain
+	{
+		std::atomic<std::uint64_t> epoch{1};
+		std::atomic<Record*> records{nullptr};
+	public:
+		Record *acquire()
+		{
+			for(auto record = records.load(std::memory_order_acquire); record != nullptr; record = record->next)
+			{
+				bool expected = false;
+				if(!record->inUse.load(std::memory_order_relaxed)
+						&& record->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+					return record;
+			}
+			auto record = new Record;
+			record->next = records.load(std::memory_order_relaxed);
+			while(!records.compare_exchange_weak(record->next, record, std::memory_order_release,
+					std::memory_order_relaxed))
+				;
+			return record;
+		}
+
+		void release(Record *record)
+		{
+			record->active.store(0, std::memory_order_release);
+			record->inUse.store(false, std::memory_order_release);
+		}
+
+		// Guards nest, only the outermost one announces an epoch.
+		void enter(Record& record)
+		{
+			if(record.depth++ != 0)
+				return;
+			record.active.store(epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+			// the announcement must be visible before the reader loads any pointer of the container
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		void leave(Record& record)
+		{
+			if(--record.depth == 0)
+				record.active.store(0, std::memory_order_release);
+		}
+
+		// Epoch to retire a node with, read after the node was unlinked.
+		std::uint64_t current() const
+		{
+			return epoch.load(std::memory_order_seq_cst);
+		}
+
+		// Starts a new epoch and returns the oldest one a reader may still be in. Nodes retired in an
+		// epoch before it are unreachable for every reader.
+		std::uint64_t advance()
+		{
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto safe = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+			for(auto record = records.load(std::memory_order_acquire); record != nullptr; record = record->next)
+			{
+				auto active = record->active.load(std::memory_order_acquire);
+				if(active != 0 && active < safe)
+					safe = active;
+			}
+			return safe;
+		}
+	};
+
+	// One domain for the whole program, so a thread holds a single record however many containers
+	// it reads.
+	inline Domain& domain()
+	{
+		static Domain instance;
+		return instance;
+	}
+
+	// Record of the calling thread, handed back to the domain when the thread exits.
+	inline Record& threadRecord()
+	{
+		thread_local struct Holder
+		{
+			Record *record = domain().acquire();
+
+			~Holder()
+			{
+				domain().release(record);
+			}
+		} holder;
+		return *holder.record;
+	}
+
+	// Nodes reachable when a guard is entered stay allocated until it is left.
+	class Guard
+	{
+		Record &record;
+	public:
+		Guard() : record(threadRecord())
+		{
+			domain().enter(record);
+		}
+
+		~Guard()
+		{
+			domain().leave(record);
+		}
+
+		Guard(const Guard&) = delete;
+		Guard& operator=(const Guard&) = delete;
+	};
+}
+
+}
+
+#endif /* AISDI_MAPS_EPOCH_H */
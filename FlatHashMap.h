@@ -0,0 +1,862 @@
+#ifndef AISDI_MAPS_FLATHASHMAP_H
+#define AISDI_MAPS_FLATHASHMAP_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+#include <type_traits>
+
+#include "Hashing.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AISDI_FLAT_SSE2 1
+#endif
+
+namespace aisdi
+{
+
+namespace flat
+{
+	// Control byte of a slot: a full slot stores the low 7 bits of its hash (0..127), so the sign bit
+	// alone tells full slots from empty and deleted ones.
+	using ctrl_t = std::int8_t;
+	constexpr ctrl_t empty = -128;
+	constexpr ctrl_t deleted = -2;
+	constexpr std::size_t groupWidth = 16;
+
+	inline unsigned trailingZeros(std::uint32_t mask)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctz(mask);
+#else
+		unsigned count = 0;
+		while((mask & 1) == 0)
+		{
+			mask >>= 1;
+			count++;
+		}
+		return count;
+#endif
+	}
+
+	// Sixteen control bytes scanned at once. Every returned mask has bit i set for slot i of the group.
+	class Group
+	{
+#if defined(AISDI_FLAT_SSE2)
+		__m128i ctrl;
+	public:
+		explicit Group(const ctrl_t *pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+		std::uint32_t match(ctrl_t h2) const
+		{
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+		}
+
+		std::uint32_t matchEmpty() const
+		{
+			return match(empty);
+		}
+
+		std::uint32_t matchEmptyOrDeleted() const
+		{
+			return static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl));
+		}
+#else
+		const ctrl_t *ctrl;
+	public:
+		explicit Group(const ctrl_t *pos) : ctrl(pos) {}
+
+		std::uint32_t match(ctrl_t h2) const
+		{
+			std::uint32_t mask = 0;
+			for(std::size_t i = 0; i < groupWidth; i++)
+				if(ctrl[i] == h2)
+					mask |= 1u << i;
+			return mask;
+		}
+
+		std::uint32_t matchEmpty() const
+		{
+			return match(empty);
+		}
+
+		std::uint32_t matchEmptyOrDeleted() const
+		{
+			std::uint32_t mask = 0;
+			for(std::size_t i = 0; i < groupWidth; i++)
+				if(ctrl[i] < 0)
+					mask |= 1u << i;
+			return mask;
+		}
+#endif
+		std::uint32_t matchFull() const
+		{
+			return ~matchEmptyOrDeleted() & 0xFFFFu;
+		}
+	};
+}
+
+// Open addressing counterpart of HashMap. Entries live inline in one slot array and a parallel
+// array of control bytes is probed a group of 16 at a time, so a lookup touches one or two cache
+// lines instead of walking a list. The price is that growing or shrinking the table relocates every
+// entry and, keys being const, copies every key: with keys that allocate, like long std::strings,
+// reserving up front pays off more than with HashMap, whose rehash only relinks nodes.
+// Only the plain key_type lookups are offered: transparent lookups, find_many, contains_many and the
+// parallel_* algorithms are left to HashMap.
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+		typename KeyEqual = std::equal_to<KeyType>,
+		typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+class FlatHashMap
+{
+public:
+  using key_type = KeyType;
+  using mapped_type = ValueType;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+
+  class ConstIterator;
+  class Iterator;
+  using iterator = Iterator;
+  using const_iterator = ConstIterator;
+private:
+	using ctrl_t = flat::ctrl_t;
+	using Group = flat::Group;
+	using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+	using SlotTraits = std::allocator_traits<SlotAllocator>;
+	static constexpr size_type groupWidth = flat::groupWidth;
+
+	ctrl_t *ctrl = nullptr;
+	value_type *slots = nullptr;
+	size_type size = 0;
+	size_type capacity = 0;
+	size_type growthLeft = 0;
+	size_type reservedCapacity = 0;
+	float maxLoadFactor = 0.875f;
+	Hash hashFunction;
+	KeyEqual keyEqual;
+	SlotAllocator allocator;
+
+	// std::hash is the identity for integers, which would leave the 7 bits kept in the control
+	// bytes almost constant, so hashes are mixed unless the hasher avalanches already
+	size_type makeHash(const key_type& key) const
+	{
+		auto hash = hashFunction(key);
+		if(!hashing::isAvalanching<Hash>::value)
+			hash = hashing::mix(hash);
+		return hash;
+	}
+	static ctrl_t h2(size_type hash)
+	{
+		return static_cast<ctrl_t>(hash & 0x7F);
+	}
+	// at least one slot is always left empty, so every probe sequence terminates
+	size_type maxElements(size_type slotCount) const
+	{
+		if(slotCount == 0)
+			return 0;
+		return std::min(slotCount - 1, static_cast<size_type>(slotCount * static_cast<double>(maxLoadFactor)));
+	}
+	static size_type roundCapacity(size_type slotCount)
+	{
+		if(slotCount == 0)
+			return 0;
+		size_type rounded = groupWidth;
+		while(rounded < slotCount)
+			rounded *= 2;
+		return rounded;
+	}
+	size_type capacityFor(size_type elements) const
+	{
+		if(elements == 0)
+			return 0;
+		size_type slotCount = groupWidth;
+		while(maxElements(slotCount) < elements)
+			slotCount *= 2;
+		return slotCount;
+	}
+	// Allocates the arrays of an empty table, releasing the first when the second cannot be had.
+	void allocTable(size_type slotCount, ctrl_t *&newCtrl, value_type *&newSlots)
+	{
+		newCtrl = nullptr;
+		newSlots = nullptr;
+		if(slotCount == 0)
+			return;
+		newSlots = SlotTraits::allocate(allocator, slotCount);
+		try
+		{
+			newCtrl = new ctrl_t [slotCount];
+		}
+		catch(...)
+		{
+			SlotTraits::deallocate(allocator, newSlots, slotCount);
+			throw;
+		}
+		std::memset(newCtrl, flat::empty, slotCount);
+	}
+	void alloc(size_type slotCount)
+	{
+		allocTable(slotCount, ctrl, slots);
+		capacity = slotCount;
+		growthLeft = maxElements(capacity);
+	}
+	void dealloc(ctrl_t *oldCtrl, value_type *oldSlots, size_type oldCapacity)
+	{
+		if(oldCapacity == 0)
+			return;
+		for(size_type i = 0; i < oldCapacity; i++)
+			if(oldCtrl[i] >= 0)
+				SlotTraits::destroy(allocator, oldSlots + i);
+		SlotTraits::deallocate(allocator, oldSlots, oldCapacity);
+		delete [] oldCtrl;
+	}
+	// Slot holding key, or capacity when it is absent. Groups are visited in triangular order,
+	// which covers every group of a power-of-two table.
+	size_type findIndex(const key_type& key, size_type hash) const
+	{
+		if(capacity == 0)
+			return capacity;
+		const size_type groupMask = capacity / groupWidth - 1;
+		size_type group = (hash >> 7) & groupMask;
+		for(size_type step = 1; ; step++)
+		{
+			Group g(ctrl + group * groupWidth);
+			for(auto mask = g.match(h2(hash)); mask != 0; mask &= mask - 1)
+			{
+				auto index = group * groupWidth + flat::trailingZeros(mask);
+				if(keyEqual(slots[index].first, key))
+					return index;
+			}
+			if(g.matchEmpty() != 0)
+				return capacity;
+			group = (group + step) & groupMask;
+		}
+	}
+	size_type findFirstNonFull(size_type hash) const
+	{
+		return findFirstNonFull(ctrl, capacity, hash);
+	}
+	static size_type findFirstNonFull(const ctrl_t *table, size_type slotCount, size_type hash)
+	{
+		const size_type groupMask = slotCount / groupWidth - 1;
+		size_type group = (hash >> 7) & groupMask;
+		for(size_type step = 1; ; step++)
+		{
+			auto mask = Group(table + group * groupWidth).matchEmptyOrDeleted();
+			if(mask != 0)
+				return group * groupWidth + flat::trailingZeros(mask);
+			group = (group + step) & groupMask;
+		}
+	}
+	// Picks the slot for a key known to be absent, growing, shrinking or purging deleted slots first
+	// when needed. The caller constructs the entry and then calls setFull.
+	size_type prepareInsert(size_type hash)
+	{
+		rebalance(size + 1);
+		auto index = findFirstNonFull(hash);
+		if(ctrl[index] == flat::empty)
+			growthLeft--;
+		return index;
+	}
+	void setFull(size_type index, size_type hash)
+	{
+		ctrl[index] = h2(hash);
+		size++;
+	}
+	// The entries are relocated into a table built aside, which replaces the old one once complete.
+	// Keys are const in the slots, so each is copied; values are moved when that cannot throw. When
+	// hashing or copying a key throws, the values moved so far are moved back and the map is unchanged.
+	void resize(size_type newCapacity)
+	{
+		constexpr bool movesValues = std::is_nothrow_move_constructible<mapped_type>::value
+				|| !std::is_copy_constructible<mapped_type>::value;
+		constexpr bool mayThrow = !std::is_nothrow_copy_constructible<key_type>::value
+				|| !noexcept(std::declval<const Hash&>()(std::declval<const key_type&>()));
+		constexpr bool movesBack = movesValues && mayThrow && std::is_nothrow_move_assignable<mapped_type>::value;
+		ctrl_t *newCtrl;
+		value_type *newSlots;
+		allocTable(newCapacity, newCtrl, newSlots);
+		// slot every entry came from, only kept when values may have to be moved back
+		std::unique_ptr<size_type[]> origin;
+		size_type i = 0;
+		try
+		{
+			if(movesBack)
+				origin.reset(new size_type [newCapacity]);
+			for(; i < capacity; i++)
+			{
+				if(ctrl[i] < 0)
+					continue;
+				auto hash = makeHash(slots[i].first);
+				auto index = findFirstNonFull(newCtrl, newCapacity, hash);
+				SlotTraits::construct(allocator, newSlots + index, slots[i].first, std::move_if_noexcept(slots[i].second));
+				newCtrl[index] = h2(hash);
+				if(movesBack)
+					origin[index] = i;
+			}
+		}
+		catch(...)
+		{
+			if constexpr(movesBack)
+				for(size_type index = 0; index < newCapacity && origin; index++)
+					if(newCtrl[index] >= 0)
+						slots[origin[index]].second = std::move(newSlots[index].second);
+			dealloc(newCtrl, newSlots, newCapacity);
+			throw;
+		}
+		dealloc(ctrl, slots, capacity);
+		ctrl = newCtrl;
+		slots = newSlots;
+		capacity = newCapacity;
+		growthLeft = maxElements(capacity) - size;
+	}
+	// Same policy as HashMap: grow past the maximum load factor, shrink below a quarter of it.
+	// A table that ran out of empty slots because of deletions is rebuilt at the same size.
+	void rebalance(size_type elements)
+	{
+		const size_type limit = maxElements(capacity);
+		if(elements > limit)
+			resize(std::max(capacity * 2, capacityFor(elements)));
+		else if(capacity > reservedCapacity && elements < limit / 4)
+			resize(std::max(reservedCapacity, capacityFor(2 * elements)));
+		else if(growthLeft == 0 && elements > size)
+			resize(capacity);
+	}
+	void eraseIndex(size_type index)
+	{
+		SlotTraits::destroy(allocator, slots + index);
+		size--;
+		// a probe only continues past a group without empty slots, so when this group already has one
+		// no probe sequence depends on the slot and it can become empty instead of deleted
+		if(Group(ctrl + index - index % groupWidth).matchEmpty() != 0)
+		{
+			ctrl[index] = flat::empty;
+			growthLeft++;
+		}
+		else
+			ctrl[index] = flat::deleted;
+	}
+	template <typename K, typename... Args>
+	std::pair<iterator, bool> tryEmplace(K&& key, Args&&... args)
+	{
+		auto hash = makeHash(key);
+		auto index = findIndex(key, hash);
+		if(index != capacity)
+			return std::make_pair(iterator(const_iterator(this, index)), false);
+		index = prepareInsert(hash);
+		SlotTraits::construct(allocator, slots + index, std::piecewise_construct,
+				std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+		setFull(index, hash);
+		return std::make_pair(iterator(const_iterator(this, index)), true);
+	}
+	// A key and a value go straight into the slot, with the key copied or moved just once.
+	template <typename K, typename M, typename = std::enable_if_t<std::is_same<std::decay_t<K>, key_type>::value>>
+	std::pair<iterator, bool> emplaceEntry(K&& key, M&& obj)
+	{
+		return tryEmplace(std::forward<K>(key), std::forward<M>(obj));
+	}
+	// Otherwise the slot depends on a key only known once the entry is built, so the entry is built on
+	// the stack with a non-const key and both halves are moved into place.
+	template <typename... Args>
+	std::pair<iterator, bool> emplaceEntry(Args&&... args)
+	{
+		std::pair<key_type, mapped_type> entry(std::forward<Args>(args)...);
+		return tryEmplace(std::move(entry.first), std::move(entry.second));
+	}
+	template <typename K, typename M>
+	std::pair<iterator, bool> insertOrAssign(K&& key, M&& obj)
+	{
+		auto result = tryEmplace(std::forward<K>(key), std::forward<M>(obj));
+		// obj is only consumed when a new entry was built from it
+		if(!result.second)
+			(*result.first).second = std::forward<M>(obj);
+		return result;
+	}
+	size_type nextFull(size_type index) const
+	{
+		while(index < capacity)
+		{
+			auto offset = index % groupWidth;
+			auto mask = Group(ctrl + index - offset).matchFull() >> offset;
+			if(mask != 0)
+				return index + flat::trailingZeros(mask);
+			index += groupWidth - offset;
+		}
+		return capacity;
+	}
+	size_type previousFull(size_type index) const
+	{
+		while(index > 0)
+		{
+			index--;
+			if(ctrl[index] >= 0)
+				return index;
+		}
+		return capacity;
+	}
+public:
+  FlatHashMap()
+  {}
+
+  explicit FlatHashMap(const Allocator& allocator)
+		: allocator(allocator)
+  {}
+
+  explicit FlatHashMap(size_type bucketCount, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+			const Allocator& allocator = Allocator())
+		: hashFunction(hash), keyEqual(equal), allocator(allocator)
+  {
+		rehash(bucketCount);
+  }
+
+	~FlatHashMap()
+	{
+		dealloc(ctrl, slots, capacity);
+	}
+
+  FlatHashMap(std::initializer_list<value_type> list)
+  {
+		reserve(list.size());
+		for(auto &&it: list)
+		{
+			(*this)[it.first] = it.second;
+		}
+  }
+
+  FlatHashMap(const FlatHashMap& other)
+		: reservedCapacity(other.reservedCapacity), maxLoadFactor(other.maxLoadFactor),
+			hashFunction(other.hashFunction), keyEqual(other.keyEqual),
+			allocator(SlotTraits::select_on_container_copy_construction(other.allocator))
+  {
+		alloc(std::max(reservedCapacity, capacityFor(other.size)));
+		for(auto &&it: other)
+		{
+			auto hash = makeHash(it.first);
+			auto index = findFirstNonFull(hash);
+			SlotTraits::construct(allocator, slots + index, it);
+			growthLeft--;
+			setFull(index, hash);
+		}
+  }
+
+  FlatHashMap(FlatHashMap&& other)
+  {
+		swap(other);
+  }
+
+  FlatHashMap& operator=(const FlatHashMap& other)
+  {
+		if(this != &other)
+		{
+			FlatHashMap copy(other);
+			swap(copy);
+		}
+		return *this;
+  }
+
+  FlatHashMap& operator=(FlatHashMap&& other)
+  {
+		if(this != &other)
+			swap(other);
+		return *this;
+  }
+
+  void swap(FlatHashMap& other)
+  {
+		std::swap(ctrl, other.ctrl);
+		std::swap(slots, other.slots);
+		std::swap(size, other.size);
+		std::swap(capacity, other.capacity);
+		std::swap(growthLeft, other.growthLeft);
+		std::swap(reservedCapacity, other.reservedCapacity);
+		std::swap(maxLoadFactor, other.maxLoadFactor);
+		std::swap(hashFunction, other.hashFunction);
+		std::swap(keyEqual, other.keyEqual);
+		std::swap(allocator, other.allocator);
+  }
+
+  allocator_type get_allocator() const
+  {
+		return allocator_type(allocator);
+  }
+
+  hasher hash_function() const
+  {
+		return hashFunction;
+  }
+
+  key_equal key_eq() const
+  {
+		return keyEqual;
+  }
+
+  bool isEmpty() const
+  {
+    return size == 0;
+  }
+
+  mapped_type& operator[](const key_type& key)
+  {
+		return (*tryEmplace(key).first).second;
+  }
+
+  mapped_type& operator[](key_type&& key)
+  {
+		return (*tryEmplace(std::move(key)).first).second;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+		return emplaceEntry(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+  {
+		return tryEmplace(key, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+  {
+		return tryEmplace(std::move(key), std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& obj)
+  {
+		return insertOrAssign(key, std::forward<M>(obj));
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(key_type&& key, M&& obj)
+  {
+		return insertOrAssign(std::move(key), std::forward<M>(obj));
+  }
+
+  const mapped_type& valueOf(const key_type& key) const
+  {
+		auto index = findIndex(key, makeHash(key));
+		if(index == capacity)
+			throw std::out_of_range("valueof");
+		return slots[index].second;
+  }
+
+  mapped_type& valueOf(const key_type& key)
+  {
+		auto index = findIndex(key, makeHash(key));
+		if(index == capacity)
+			throw std::out_of_range("valueof");
+		return slots[index].second;
+  }
+
+  const_iterator find(const key_type& key) const
+  {
+		return const_iterator(this, findIndex(key, makeHash(key)));
+  }
+
+  iterator find(const key_type& key)
+  {
+		return iterator(const_iterator(this, findIndex(key, makeHash(key))));
+  }
+
+  bool contains(const key_type& key) const
+  {
+		return findIndex(key, makeHash(key)) != capacity;
+  }
+
+  // The value of key, or nullptr when it is missing. Unlike valueOf a miss throws nothing.
+  const mapped_type* get_if(const key_type& key) const
+  {
+		auto index = findIndex(key, makeHash(key));
+		return index == capacity ? nullptr : &slots[index].second;
+  }
+
+  mapped_type* get_if(const key_type& key)
+  {
+		auto index = findIndex(key, makeHash(key));
+		return index == capacity ? nullptr : &slots[index].second;
+  }
+
+  void remove(const key_type& key)
+  {
+		if(erase(key) == 0)
+			throw std::out_of_range("remove");
+  }
+
+  void remove(const const_iterator& it)
+	{
+		erase(it);
+  }
+
+  // Erasing never moves other entries, so the next iterator is simply the next full slot.
+  iterator erase(const_iterator position)
+  {
+		if(position.map != this || position.index >= capacity)
+			throw std::out_of_range("erase");
+		eraseIndex(position.index);
+		return iterator(const_iterator(this, nextFull(position.index + 1)));
+  }
+
+  iterator erase(iterator position)
+  {
+		return erase(const_iterator(position));
+  }
+
+  size_type erase(const key_type& key)
+  {
+		auto index = findIndex(key, makeHash(key));
+		if(index == capacity)
+			return 0;
+		eraseIndex(index);
+		return 1;
+  }
+
+  // Destroys every entry but keeps the table, so refilling it up to the same size does not resize.
+  void clear()
+  {
+		for(size_type i = 0; i < capacity; i++)
+			if(ctrl[i] >= 0)
+				SlotTraits::destroy(allocator, slots + i);
+		if(capacity != 0)
+			std::memset(ctrl, flat::empty, capacity);
+		size = 0;
+		growthLeft = maxElements(capacity);
+  }
+
+  size_type getSize() const
+  {
+    return size;
+  }
+
+  size_type bucket_count() const
+  {
+		return capacity;
+  }
+
+  float load_factor() const
+  {
+		return capacity == 0 ? 0.0f : static_cast<float>(size) / capacity;
+  }
+
+  float max_load_factor() const
+  {
+		return maxLoadFactor;
+  }
+
+  // Values above 7/8 are accepted but one slot is always kept empty.
+  void max_load_factor(float ml)
+  {
+		if(!(ml > 0))
+			throw std::invalid_argument("max_load_factor");
+		maxLoadFactor = ml;
+		resize(std::max(reservedCapacity, capacityFor(size)));
+  }
+
+  void rehash(size_type count)
+  {
+		reservedCapacity = roundCapacity(count);
+		resize(std::max(reservedCapacity, capacityFor(size)));
+  }
+
+  void reserve(size_type count)
+  {
+		rehash(capacityFor(count));
+  }
+
+  bool operator==(const FlatHashMap& other) const
+  {
+		if(size != other.size)
+			return false;
+		for(auto &&it: *this)
+		{
+			auto found = other.find(it.first);
+			if(found == other.end() || !(found->second == it.second))
+				return false;
+		}
+		return true;
+  }
+
+  bool operator!=(const FlatHashMap& other) const
+  {
+    return !(*this == other);
+  }
+
+  iterator begin()
+  {
+		return iterator(cbegin());
+  }
+
+  iterator end()
+  {
+		return iterator(cend());
+  }
+
+  const_iterator cbegin() const
+  {
+		return const_iterator(this, nextFull(0));
+  }
+
+  const_iterator cend() const
+  {
+		return const_iterator(this, capacity);
+  }
+
+  const_iterator begin() const
+  {
+    return cbegin();
+  }
+
+  const_iterator end() const
+  {
+    return cend();
+  }
+};
+
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+class FlatHashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::ConstIterator
+{
+public:
+  using reference = typename FlatHashMap::const_reference;
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = typename FlatHashMap::value_type;
+  using pointer = const typename FlatHashMap::value_type*;
+
+private:
+	friend class FlatHashMap;
+
+	const FlatHashMap *map = nullptr;
+	size_type index = 0;
+
+public:
+
+  explicit ConstIterator()
+  {}
+
+	ConstIterator(const FlatHashMap *map, size_type index)
+			:map(map), index(index){}
+
+  ConstIterator(const ConstIterator& other):map(other.map),index(other.index) {}
+
+  ConstIterator& operator=(const ConstIterator& other) = default;
+
+  ConstIterator& operator++()
+  {
+		if(map == nullptr || index >= map->capacity) throw std::out_of_range("op++");
+		index = map->nextFull(index + 1);
+		return *this;
+  }
+
+  ConstIterator operator++(int)
+  {
+    auto tmp = *this;
+		++(*this);
+		return tmp;
+  }
+
+  ConstIterator& operator--()
+  {
+		if(map == nullptr) throw std::out_of_range("op--");
+		auto previous = map->previousFull(index);
+		if(previous == map->capacity) throw std::out_of_range("op--");
+		index = previous;
+		return *this;
+  }
+
+  ConstIterator operator--(int)
+  {
+		auto tmp = *this;
+		--(*this);
+		return tmp;
+  }
+
+  reference operator*() const
+  {
+    if(map == nullptr || index >= map->capacity) throw std::out_of_range("op*");
+		return map->slots[index];
+  }
+
+  pointer operator->() const
+  {
+    return &this->operator*();
+  }
+
+  bool operator==(const ConstIterator& other) const
+  {
+    return (map == other.map && index == other.index);
+  }
+
+  bool operator!=(const ConstIterator& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator>
+class FlatHashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::Iterator
+		: public FlatHashMap<KeyType, ValueType, Hash, KeyEqual, Allocator>::ConstIterator
+{
+public:
+  using reference = typename FlatHashMap::reference;
+  using pointer = typename FlatHashMap::value_type*;
+
+  explicit Iterator()
+  {}
+
+  Iterator(const ConstIterator& other)
+    : ConstIterator(other)
+  {}
+
+  Iterator& operator++()
+  {
+    ConstIterator::operator++();
+    return *this;
+  }
+
+  Iterator operator++(int)
+  {
+    auto result = *this;
+    ConstIterator::operator++();
+    return result;
+  }
+
+  Iterator& operator--()
+  {
+    ConstIterator::operator--();
+    return *this;
+  }
+
+  Iterator operator--(int)
+  {
+    auto result = *this;
+    ConstIterator::operator--();
+    return result;
+  }
+
+  pointer operator->() const
+  {
+    return &this->operator*();
+  }
+
+  reference operator*() const
+  {
+    // ugly cast, yet reduces code duplication.
+    return const_cast<reference>(ConstIterator::operator*());
+  }
+};
+
+}
+
+#endif /* AISDI_MAPS_FLATHASHMAP_H */
@@ -5,11 +5,30 @@
 #include <stdexcept>
 #include <utility>
 #include <list>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <functional>
+#include <type_traits>
+#include <iterator>
+#include <string>
+
+#include "Hashing.h"
+#include "Parallel.h"
+#include "Snapshot.h"
 
 namespace aisdi
 {
 
-template <typename KeyType, typename ValueType>
+// Hash and KeyEqual work as in std::unordered_map. BucketPolicy picks the bucket counts and how a
+// hash is reduced to a bucket index, see Hashing.h.
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+		typename KeyEqual = std::equal_to<KeyType>,
+		typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+		typename BucketPolicy = PrimeModuloPolicy>
 class HashMap
 {
 public:
@@ -19,23 +38,389 @@ public:
   using size_type = std::size_t;
   using reference = value_type&;
   using const_reference = const value_type&;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
 
   class ConstIterator;
   class Iterator;
   using iterator = Iterator;
   using const_iterator = ConstIterator;
 private:
-	std::list<value_type> *hashTable;
+	static constexpr size_type minCapacity = BucketPolicy::minBucketCount;
+	static constexpr bool cachesHash = hashing::cacheHashCode<Hash>::value;
+	static constexpr size_type lookupGroup = 16; // keys whose lookups find_many overlaps
+	static constexpr bool transparent = hashing::isTransparent<Hash>::value && hashing::isTransparent<KeyEqual>::value;
+
+	// Enables the lookups by any key type K when both Hash and KeyEqual are transparent.
+	template <typename K>
+	using IfTransparent = std::enable_if_t<transparent, K>;
+
+	// Entry of a map that caches hash codes. Lookups compare the stored codes before the keys and
+	// resizing or copying never calls the hasher again.
+	struct CachedEntry
+	{
+		value_type value;
+		size_type hash = 0;
+
+		template <typename... Args>
+		explicit CachedEntry(std::in_place_t, Args&&... args) : value(std::forward<Args>(args)...)
+		{}
+	};
+	using Entry = typename std::conditional<cachesHash, CachedEntry, value_type>::type;
+	using EntryAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>;
+	using Bucket = std::list<Entry, EntryAllocator>;
+	using BucketAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Bucket>;
+	using BucketTraits = std::allocator_traits<BucketAllocator>;
+
+	Hash hashFunction;
+	KeyEqual keyEqual;
+	EntryAllocator allocator;
+	Bucket *hashTable;
+	std::vector<std::uint64_t> occupied; // one bit per non-empty bucket
 	size_type size = 0;
-	const size_type capacity = 64037;
+	size_type capacity = minCapacity;
+	size_type reservedCapacity = minCapacity;
 	size_type beginPos = capacity;
+	float maxLoadFactor = 1.0f;
+
 	void alloc()
 	{
-		hashTable = new std::list<value_type> [capacity];
+		// every bucket gets a copy of the map's allocator, so entries of all buckets share its pools
+		BucketAllocator bucketAllocator(allocator);
+		hashTable = BucketTraits::allocate(bucketAllocator, capacity);
+		for(size_type i = 0; i < capacity; i++)
+			BucketTraits::construct(bucketAllocator, hashTable + i, allocator);
+		occupied.assign((capacity + 63) / 64, 0);
+		beginPos = capacity;
+	}
+	// Table of a map whose entries were moved away: one empty bucket shared by all such maps, so a move
+	// allocates nothing. It is only ever read, the first insert replaces it with a table of its own.
+	static Bucket *emptyTable()
+	{
+		static Bucket bucket{EntryAllocator()};
+		return &bucket;
+	}
+	void dealloc(Bucket *table, size_type count)
+	{
+		if(table == nullptr || table == emptyTable())
+			return;
+		BucketAllocator bucketAllocator(allocator);
+		for(size_type i = 0; i < count; i++)
+			BucketTraits::destroy(bucketAllocator, table + i);
+		BucketTraits::deallocate(bucketAllocator, table, count);
+	}
+	static unsigned countTrailingZeros(std::uint64_t word)
+	{
+#if defined(__GNUC__)
+		return __builtin_ctzll(word);
+#else
+		unsigned count = 0;
+		for(; (word & 1) == 0; word >>= 1)
+			count++;
+		return count;
+#endif
+	}
+	static unsigned countLeadingZeros(std::uint64_t word)
+	{
+#if defined(__GNUC__)
+		return __builtin_clzll(word);
+#else
+		unsigned count = 0;
+		for(; (word & (std::uint64_t(1) << 63)) == 0; word <<= 1)
+			count++;
+		return count;
+#endif
+	}
+	static void prefetch(const void* address)
+	{
+#if defined(__GNUC__)
+		__builtin_prefetch(address);
+#else
+		(void) address;
+#endif
+	}
+	void markOccupied(size_type bucket)
+	{
+		occupied[bucket / 64] |= std::uint64_t(1) << (bucket % 64);
+		if(bucket < beginPos) beginPos = bucket;
+	}
+	void markEmpty(size_type bucket)
+	{
+		occupied[bucket / 64] &= ~(std::uint64_t(1) << (bucket % 64));
+		if(bucket == beginPos) beginPos = nextOccupied(bucket);
+	}
+	// first non-empty bucket at or after bucket, capacity if there is none
+	size_type nextOccupied(size_type bucket) const
+	{
+		auto word = bucket / 64;
+		if(word >= occupied.size())
+			return capacity;
+		auto bits = occupied[word] & (~std::uint64_t(0) << (bucket % 64));
+		while(bits == 0)
+		{
+			if(++word == occupied.size())
+				return capacity;
+			bits = occupied[word];
+		}
+		return word * 64 + countTrailingZeros(bits);
+	}
+	// last non-empty bucket before bucket, capacity if there is none
+	size_type previousOccupied(size_type bucket) const
+	{
+		if(bucket == 0 || occupied.empty())
+			return capacity;
+		auto word = (bucket - 1) / 64;
+		auto bits = occupied[word] & (~std::uint64_t(0) >> (63 - (bucket - 1) % 64));
+		while(bits == 0)
+		{
+			if(word-- == 0)
+				return capacity;
+			bits = occupied[word];
+		}
+		return word * 64 + 63 - countLeadingZeros(bits);
+	}
+	template <typename K>
+	size_type hashCode(const K& key) const
+	{
+		auto hash = hashFunction(key);
+		if(BucketPolicy::needsMixing && !hashing::isAvalanching<Hash>::value)
+			hash = hashing::mix(hash);
+		return hash;
 	}
-	size_type makeHash(key_type key) const
+	size_type bucketOf(size_type hash) const
 	{
-		return std::hash<key_type> () (key) % capacity;
+		return BucketPolicy::index(hash, capacity);
+	}
+	static value_type& entryValue(value_type& entry)
+	{
+		return entry;
+	}
+	static value_type& entryValue(CachedEntry& entry)
+	{
+		return entry.value;
+	}
+	size_type entryHash(const value_type& entry) const
+	{
+		return hashCode(entry.first);
+	}
+	size_type entryHash(const CachedEntry& entry) const
+	{
+		return entry.hash;
+	}
+	template <typename K>
+	bool entryMatches(const value_type& entry, size_type, const K& key) const
+	{
+		return keyEqual(entry.first, key);
+	}
+	template <typename K>
+	bool entryMatches(const CachedEntry& entry, size_type hash, const K& key) const
+	{
+		return entry.hash == hash && keyEqual(entry.value.first, key);
+	}
+	static void storeHash(value_type&, size_type)
+	{}
+	static void storeHash(CachedEntry& entry, size_type hash)
+	{
+		entry.hash = hash;
+	}
+	template <typename... Args>
+	void emplaceEntry(Bucket& entry, Args&&... args)
+	{
+		if constexpr(cachesHash)
+			entry.emplace_front(std::in_place, std::forward<Args>(args)...);
+		else
+			entry.emplace_front(std::forward<Args>(args)...);
+	}
+	size_type bucketsFor(size_type elements) const
+	{
+		return static_cast<size_type>(std::ceil(elements / static_cast<double>(maxLoadFactor)));
+	}
+	void resize(size_type newCapacity)
+	{
+		if(newCapacity == capacity)
+			return;
+		auto oldTable = hashTable;
+		auto oldCapacity = capacity;
+		capacity = newCapacity;
+		alloc();
+		// splicing moves the list nodes themselves, so no entry is copied or reallocated
+		for(size_type i = 0; i < oldCapacity; i++)
+		{
+			while(!oldTable[i].empty())
+			{
+				auto bucket = bucketOf(entryHash(oldTable[i].front()));
+				hashTable[bucket].splice(hashTable[bucket].begin(), oldTable[i], oldTable[i].begin());
+				markOccupied(bucket);
+			}
+		}
+		dealloc(oldTable, oldCapacity);
+	}
+	// Grows the table before it exceeds the maximum load factor. Shrinking is done here as well, on the
+	// insertion path, so that removals never invalidate iterators to the remaining entries.
+	void rebalance(size_type elements)
+	{
+		const double limit = capacity * static_cast<double>(maxLoadFactor);
+		if(elements > limit || (elements > 0 && hashTable == emptyTable()))
+			resize(BucketPolicy::bucketCount(std::max(capacity * 2, bucketsFor(elements))));
+		else if(capacity > reservedCapacity && elements < limit / 4)
+			resize(BucketPolicy::bucketCount(std::max(reservedCapacity, bucketsFor(2 * elements))));
+	}
+	template <typename K>
+	typename Bucket::iterator findInBucket(size_type bucket, size_type hash, const K& key) const
+	{
+		auto it = hashTable[bucket].begin();
+		while(it != hashTable[bucket].end() && !entryMatches(*it, hash, key))
+			++it;
+		return it;
+	}
+	template <typename K>
+	const_iterator findKey(const K& key) const
+	{
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto it = findInBucket(bucket, hash, key);
+		if(it == hashTable[bucket].end())
+			return end();
+		return const_iterator(const_cast<HashMap&> (*this), hashTable + bucket, it);
+	}
+	template <typename K>
+	mapped_type* findValue(const K& key) const
+	{
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto it = findInBucket(bucket, hash, key);
+		return it == hashTable[bucket].end() ? nullptr : &entryValue(*it).second;
+	}
+	// Looks the keys of [first, last) up a group at a time: every key of a group is hashed and its
+	// bucket prefetched, then the first entry of every bucket, and only then are keys compared, so the
+	// cache misses of a group overlap instead of following one another.
+	template <typename KeyIt, typename Visit>
+	void findEach(KeyIt first, KeyIt last, Visit visit) const
+	{
+		const key_type* keys[lookupGroup];
+		size_type hashes[lookupGroup];
+		Bucket* buckets[lookupGroup];
+		while(first != last)
+		{
+			size_type count = 0;
+			for(; first != last && count < lookupGroup; ++first, count++)
+			{
+				keys[count] = &*first;
+				hashes[count] = hashCode(*first);
+				buckets[count] = hashTable + bucketOf(hashes[count]);
+				prefetch(buckets[count]);
+			}
+			for(size_type i = 0; i < count; i++)
+				if(!buckets[i]->empty())
+					prefetch(&*buckets[i]->begin());
+			for(size_type i = 0; i < count; i++)
+				visit(buckets[i], findInBucket(buckets[i] - hashTable, hashes[i], *keys[i]));
+		}
+	}
+	// Calls visit with every entry of the buckets of chunk, one of chunks even slices of the table.
+	template <typename Visit>
+	void visitChunk(size_type chunk, size_type chunks, Visit&& visit) const
+	{
+		auto first = capacity * chunk / chunks, last = capacity * (chunk + 1) / chunks;
+		for(auto bucket = nextOccupied(first); bucket < last; bucket = nextOccupied(bucket + 1))
+			for(auto &&entry: hashTable[bucket])
+				visit(entryValue(entry));
+	}
+	// Links a one-entry list holding a key that is not in the map into its bucket. The node itself is
+	// moved, so the entry is never copied.
+	iterator linkEntry(size_type bucket, Bucket& entry)
+	{
+		auto oldCapacity = capacity;
+		rebalance(size + 1);
+		if(capacity != oldCapacity)
+			bucket = bucketOf(entryHash(entry.front()));
+		hashTable[bucket].splice(hashTable[bucket].begin(), entry);
+		size++;
+		markOccupied(bucket);
+		return iterator(const_iterator(*this, hashTable + bucket, hashTable[bucket].begin()));
+	}
+	// The keys of other are unique and the table is already sized for them, so its entries are linked
+	// in without lookups, and without hashing when hash codes are cached.
+	void copyEntries(const HashMap& other)
+	{
+		for(auto i = other.beginPos; i < other.capacity; i = other.nextOccupied(i + 1))
+		{
+			for(auto &&entry: other.hashTable[i])
+			{
+				auto bucket = bucketOf(entryHash(entry));
+				hashTable[bucket].push_front(entry);
+				size++;
+				markOccupied(bucket);
+			}
+		}
+	}
+	// Fills the empty table, already sized for count elements, from first[0, count) on threads
+	// threads. The first pass hashes one slice of the input per thread and routes every element to the
+	// thread owning its bucket. Owners hold ranges of whole words of the occupancy bitmap, so the
+	// second pass links entries in without locks. Every owner takes the slices in input order, so of
+	// equal keys the first is kept, as when inserting one by one.
+	template <typename RandomIt>
+	void buildFrom(RandomIt first, size_type count, unsigned threads)
+	{
+		struct Route
+		{
+			size_type index, hash, bucket;
+		};
+		std::vector<std::vector<Route>> routes(threads * threads); // routes[slice * threads + owner]
+		auto bucketsPerThread = ((capacity + threads - 1) / threads + 63) / 64 * 64;
+		parallel::run(threads, [&](unsigned slice) {
+			for(auto i = count * slice / threads; i < count * (slice + 1) / threads; i++)
+			{
+				auto hash = hashCode(first[i].first);
+				auto bucket = bucketOf(hash);
+				routes[slice * threads + bucket / bucketsPerThread].push_back(Route{i, hash, bucket});
+			}
+		});
+		std::vector<size_type> sizes(threads);
+		parallel::run(threads, [&](unsigned owner) {
+			size_type added = 0;
+			for(unsigned slice = 0; slice < threads; slice++)
+			{
+				for(auto &&route: routes[slice * threads + owner])
+				{
+					auto &&element = first[route.index];
+					if(findInBucket(route.bucket, route.hash, element.first) != hashTable[route.bucket].end())
+						continue;
+					emplaceEntry(hashTable[route.bucket], element);
+					storeHash(hashTable[route.bucket].front(), route.hash);
+					occupied[route.bucket / 64] |= std::uint64_t(1) << (route.bucket % 64);
+					added++;
+				}
+			}
+			sizes[owner] = added;
+		});
+		for(auto added: sizes)
+			size += added;
+		beginPos = nextOccupied(0);
+	}
+	template <typename K, typename... Args>
+	std::pair<iterator, bool> tryEmplace(K&& key, Args&&... args)
+	{
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto found = findInBucket(bucket, hash, key);
+		if(found != hashTable[bucket].end())
+			return std::make_pair(iterator(const_iterator(*this, hashTable + bucket, found)), false);
+		Bucket entry(allocator);
+		emplaceEntry(entry, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+				std::forward_as_tuple(std::forward<Args>(args)...));
+		storeHash(entry.front(), hash);
+		return std::make_pair(linkEntry(bucket, entry), true);
+	}
+	template <typename K, typename M>
+	std::pair<iterator, bool> insertOrAssign(K&& key, M&& obj)
+	{
+		auto result = tryEmplace(std::forward<K>(key), std::forward<M>(obj));
+		// obj is only consumed when a new entry was built from it
+		if(!result.second)
+			(*result.first).second = std::forward<M>(obj);
+		return result;
 	}
 public:
   HashMap()
@@ -43,10 +428,23 @@ public:
 		alloc();
 	}
 
+  explicit HashMap(const Allocator& allocator)
+		: allocator(allocator)
+  {
+		alloc();
+	}
+
+  explicit HashMap(size_type bucketCount, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+			const Allocator& allocator = Allocator())
+		: hashFunction(hash), keyEqual(equal), allocator(allocator)
+  {
+		reservedCapacity = capacity = BucketPolicy::bucketCount(std::max(bucketCount, minCapacity));
+		alloc();
+	}
+
 	~HashMap()
 	{
-		if(hashTable != nullptr)
-			delete [] hashTable;
+		dealloc(hashTable, capacity);
 	}
 
   HashMap(std::initializer_list<value_type> list)
@@ -58,56 +456,122 @@ public:
 		}
   }
 
-  HashMap(const HashMap& other)
+  // Builds the map from [first, last) in a table sized for all of it, keeping the first of equal keys
+  // as inserting them in order would. Random access input is hashed and linked in on up to threads
+  // threads, which needs a stateless allocator like std::allocator; with others one thread is used.
+  template <typename InputIt, typename = typename std::iterator_traits<InputIt>::iterator_category>
+  HashMap(InputIt first, InputIt last, unsigned threads = 1)
   {
-		alloc();
-		for(auto &&it: other)
+		using Category = typename std::iterator_traits<InputIt>::iterator_category;
+		if constexpr(std::is_base_of<std::random_access_iterator_tag, Category>::value)
 		{
-			(*this)[it.first] = it.second;
+			auto count = static_cast<size_type>(last - first);
+			capacity = BucketPolicy::bucketCount(std::max(minCapacity, bucketsFor(count)));
+			alloc();
+			if(!std::allocator_traits<Allocator>::is_always_equal::value)
+				threads = 1;
+			threads = parallel::threadsFor(count, threads);
+			try
+			{
+				buildFrom(first, count, threads);
+			}
+			catch(...)
+			{
+				dealloc(hashTable, capacity);
+				throw;
+			}
+		}
+		else
+		{
+			(void) threads;
+			alloc();
+			try
+			{
+				for(; first != last; ++first)
+					emplace(*first);
+			}
+			catch(...)
+			{
+				dealloc(hashTable, capacity);
+				throw;
+			}
 		}
   }
 
-  HashMap(HashMap&& other)
+  HashMap(const HashMap& other)
+		: hashFunction(other.hashFunction), keyEqual(other.keyEqual), allocator(std::allocator_traits<EntryAllocator>::select_on_container_copy_construction(other.allocator)),
+			reservedCapacity(other.reservedCapacity), maxLoadFactor(other.maxLoadFactor)
   {
-		hashTable = other.hashTable;
-		other.hashTable = nullptr;
-		size = other.size;
+		capacity = BucketPolicy::bucketCount(std::max(reservedCapacity, bucketsFor(other.size)));
+		alloc();
+		copyEntries(other);
+  }
+
+  // Takes the table of other, which is left empty on the shared empty table, so moving allocates
+  // nothing and cannot throw.
+  HashMap(HashMap&& other) noexcept
+		: hashFunction(other.hashFunction), keyEqual(other.keyEqual), allocator(other.allocator),
+			hashTable(other.hashTable), occupied(std::move(other.occupied)), size(other.size), capacity(other.capacity),
+			reservedCapacity(other.reservedCapacity), beginPos(other.beginPos), maxLoadFactor(other.maxLoadFactor)
+  {
+		other.hashTable = emptyTable();
+		other.occupied.clear();
 		other.size = 0;
-		beginPos = other.beginPos;
+		other.capacity = 1;
+		other.beginPos = 1;
   }
 
+  // The copy is built aside and swapped in, so a failed copy leaves this map as it was. The map keeps
+  // its allocator, which is not propagated on copy assignment.
   HashMap& operator=(const HashMap& other)
   {
-		if(*this == other)
+		if(this == &other)
 			return *this;
-    for(size_type i = 0;i < capacity;i++)
-		{
-			hashTable[i].clear();
-		}
-		size = 0;
-		beginPos = capacity;
-		for(auto && it: other)
-		{
-			(*this)[it.first] = it.second;
-		}
+		HashMap copy(BucketPolicy::bucketCount(std::max(other.reservedCapacity, other.bucketsFor(other.size))),
+				other.hashFunction, other.keyEqual, get_allocator());
+		copy.reservedCapacity = other.reservedCapacity;
+		copy.maxLoadFactor = other.maxLoadFactor;
+		copy.copyEntries(other);
+		swap(copy);
 		return *this;
   }
 
   HashMap& operator=(HashMap&& other)
   {
-		if(*this == other)
-			return *this;
-		if(hashTable != nullptr)
-			delete [] hashTable;
-		hashTable = other.hashTable;
-		beginPos = other.beginPos;
-		size = other.size;
-		other.size = 0;
-		other.hashTable = nullptr;
-		//other.beginPos = nullptr;
+		if(this != &other)
+			swap(other);
 		return *this;
   }
 
+  void swap(HashMap& other)
+  {
+		std::swap(hashFunction, other.hashFunction);
+		std::swap(keyEqual, other.keyEqual);
+		std::swap(allocator, other.allocator);
+		std::swap(hashTable, other.hashTable);
+		occupied.swap(other.occupied);
+		std::swap(size, other.size);
+		std::swap(capacity, other.capacity);
+		std::swap(reservedCapacity, other.reservedCapacity);
+		std::swap(beginPos, other.beginPos);
+		std::swap(maxLoadFactor, other.maxLoadFactor);
+  }
+
+  allocator_type get_allocator() const
+  {
+		return allocator_type(allocator);
+  }
+
+  hasher hash_function() const
+  {
+		return hashFunction;
+  }
+
+  key_equal key_eq() const
+  {
+		return keyEqual;
+  }
+
   bool isEmpty() const
   {
     return size == 0;
@@ -115,63 +579,278 @@ public:
 
   mapped_type& operator[](const key_type& key)
   {
-		auto hash = makeHash(key);
-		for(auto it = hashTable[hash].begin(); it != hashTable[hash].end(); ++it) {
-			if((*it).first == key)
-				return (*it).second;
-		}
-		size++;
-		if(hash < beginPos) beginPos = hash;
-		hashTable[hash].push_front(std::make_pair(key, mapped_type()));
-		return hashTable[hash].front().second;
+		return (*tryEmplace(key).first).second;
+  }
+
+  mapped_type& operator[](key_type&& key)
+  {
+		return (*tryEmplace(std::move(key)).first).second;
+  }
+
+  // The entry is built before its key is known, so it is constructed in a detached one-node list and
+  // spliced into its bucket, or dropped when the key is already present.
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+		Bucket entry(allocator);
+		emplaceEntry(entry, std::forward<Args>(args)...);
+		auto &key = entryValue(entry.front()).first;
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto found = findInBucket(bucket, hash, key);
+		if(found != hashTable[bucket].end())
+			return std::make_pair(iterator(const_iterator(*this, hashTable + bucket, found)), false);
+		storeHash(entry.front(), hash);
+		return std::make_pair(linkEntry(bucket, entry), true);
+  }
+
+  // Constructs the value from args only when key is absent; otherwise args are left untouched.
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+  {
+		return tryEmplace(key, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+  {
+		return tryEmplace(std::move(key), std::forward<Args>(args)...);
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& obj)
+  {
+		return insertOrAssign(key, std::forward<M>(obj));
+  }
+
+  template <typename M>
+  std::pair<iterator, bool> insert_or_assign(key_type&& key, M&& obj)
+  {
+		return insertOrAssign(std::move(key), std::forward<M>(obj));
   }
 
   const mapped_type& valueOf(const key_type& key) const
   {
-		auto hash = makeHash(key);
-		for(auto it = hashTable[hash].begin(); it != hashTable[hash].end(); ++it)
-			if((*it).first == key)
-				return (*it).second;
-		throw std::out_of_range("valueof");
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto it = findInBucket(bucket, hash, key);
+		if(it == hashTable[bucket].end())
+			throw std::out_of_range("valueof");
+		return entryValue(*it).second;
   }
 
   mapped_type& valueOf(const key_type& key)
   {
-		auto hash = makeHash(key);
-		for(auto it = hashTable[hash].begin(); it != hashTable[hash].end(); ++it)
-			if((*it).first == key)
-				return (*it).second;
-		throw std::out_of_range("valueof");
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto it = findInBucket(bucket, hash, key);
+		if(it == hashTable[bucket].end())
+			throw std::out_of_range("valueof");
+		return entryValue(*it).second;
   }
 
   const_iterator find(const key_type& key) const
   {
-		auto hash = makeHash(key);
-		for(auto it = hashTable[hash].begin(); it != hashTable[hash].end(); ++it)
-			if((*it).first == key)
-				return const_iterator(const_cast<HashMap&> (*this), hashTable + hash, it);
-		return end();
+		return findKey(key);
   }
 
   iterator find(const key_type& key)
   {
-		auto hash = makeHash(key);
-		for(auto it = hashTable[hash].begin(); it != hashTable[hash].end(); ++it)
-			if((*it).first == key)
-				return iterator(const_iterator(*this, hashTable + hash, it));
-		return end();
+		return iterator(findKey(key));
+  }
+
+  bool contains(const key_type& key) const
+  {
+		return findValue(key) != nullptr;
+  }
+
+  // The value of key, or nullptr when it is missing. Unlike valueOf a miss throws nothing.
+  const mapped_type* get_if(const key_type& key) const
+  {
+		return findValue(key);
+  }
+
+  mapped_type* get_if(const key_type& key)
+  {
+		return findValue(key);
+  }
+
+  // Lookups by any key type the transparent Hash and KeyEqual accept, without converting it to key_type.
+  template <typename K, typename = IfTransparent<K>>
+  const_iterator find(const K& key) const
+  {
+		return findKey(key);
+  }
+
+  template <typename K, typename = IfTransparent<K>>
+  iterator find(const K& key)
+  {
+		return iterator(findKey(key));
+  }
+
+  template <typename K, typename = IfTransparent<K>>
+  bool contains(const K& key) const
+  {
+		return findValue(key) != nullptr;
+  }
+
+  template <typename K, typename = IfTransparent<K>>
+  const mapped_type* get_if(const K& key) const
+  {
+		return findValue(key);
+  }
+
+  template <typename K, typename = IfTransparent<K>>
+  mapped_type* get_if(const K& key)
+  {
+		return findValue(key);
+  }
+
+  // Writes an iterator to out for every key of the forward range [first, last), end() for a missing
+  // one. Far faster than a find per key when the table does not fit in the cache.
+  template <typename KeyIt, typename OutIt>
+  OutIt find_many(KeyIt first, KeyIt last, OutIt out) const
+  {
+		findEach(first, last, [&](Bucket* bucket, typename Bucket::iterator it) {
+			*out++ = it == bucket->end() ? end() : const_iterator(const_cast<HashMap&>(*this), bucket, it);
+		});
+		return out;
+  }
+
+  template <typename KeyIt, typename OutIt>
+  OutIt find_many(KeyIt first, KeyIt last, OutIt out)
+  {
+		findEach(first, last, [&](Bucket* bucket, typename Bucket::iterator it) {
+			*out++ = it == bucket->end() ? end() : iterator(const_iterator(*this, bucket, it));
+		});
+		return out;
+  }
+
+  // Writes to out whether each key of [first, last) is in the map.
+  template <typename KeyIt, typename OutIt>
+  OutIt contains_many(KeyIt first, KeyIt last, OutIt out) const
+  {
+		findEach(first, last, [&](Bucket* bucket, typename Bucket::iterator it) {
+			*out++ = it != bucket->end();
+		});
+		return out;
+  }
+
+  // Calls function with every entry on up to threads threads, each taking a slice of the buckets at a
+  // time, in no particular order. Calls may run concurrently, so function must be safe for that.
+  template <typename Function>
+  void parallel_for_each(Function function, unsigned threads = parallel::defaultThreads()) const
+  {
+		threads = parallel::threadsFor(size, threads);
+		auto chunks = parallel::chunksFor(threads);
+		parallel::forEachChunk(chunks, threads, [&](size_type chunk) {
+			visitChunk(chunk, chunks, [&](const value_type& value) { function(value); });
+		});
+  }
+
+  // As above, with the mapped values open to change.
+  template <typename Function>
+  void parallel_for_each(Function function, unsigned threads = parallel::defaultThreads())
+  {
+		threads = parallel::threadsFor(size, threads);
+		auto chunks = parallel::chunksFor(threads);
+		parallel::forEachChunk(chunks, threads, [&](size_type chunk) {
+			visitChunk(chunk, chunks, [&](value_type& value) { function(value); });
+		});
+  }
+
+  // Folds every entry into a copy of identity per slice of the buckets with accumulate(T, entry), then
+  // the slices together with combine(T, T) in iteration order. combine has to be associative with
+  // identity as its neutral element; then the result is the one a sequential fold in iteration order
+  // gives.
+  template <typename T, typename Accumulate, typename Combine>
+  T parallel_reduce(T identity, Accumulate accumulate, Combine combine,
+			unsigned threads = parallel::defaultThreads()) const
+  {
+		threads = parallel::threadsFor(size, threads);
+		auto chunks = parallel::chunksFor(threads);
+		// wrapped, so that a vector of bools does not pack the results of several threads into one word
+		struct Partial
+		{
+			T value;
+		};
+		std::vector<Partial> partial(chunks, Partial{identity});
+		parallel::forEachChunk(chunks, threads, [&](size_type chunk) {
+			auto result = identity;
+			visitChunk(chunk, chunks, [&](const value_type& value) { result = accumulate(std::move(result), value); });
+			partial[chunk].value = std::move(result);
+		});
+		auto result = std::move(identity);
+		for(auto &&slot: partial)
+			result = combine(std::move(result), std::move(slot.value));
+		return result;
+  }
+
+  // Writes the map to path as an image that MappedHashMap serves lookups from without loading it, see
+  // Snapshot.h. Keys and values have to be trivially copyable.
+  void save(const std::string& path) const
+  {
+		snapshot::write<value_type>(path, size, hashFunction, [this](auto&& visit) {
+			for(auto bucket = beginPos; bucket < capacity; bucket = nextOccupied(bucket + 1))
+				for(auto &&entry: hashTable[bucket])
+					visit(entryValue(entry));
+		});
   }
 
   void remove(const key_type& key)
   {
-		size--;
-		hashTable[makeHash(key)].remove(std::make_pair(key, valueOf(key)));
+		if(erase(key) == 0)
+			throw std::out_of_range("remove");
   }
 
   void remove(const const_iterator& it)
 	{
+		erase(it);
+  }
+
+  // Unlinks the entry the iterator already points at, without hashing or comparing anything, and
+  // returns the iterator to the entry after it.
+  iterator erase(const_iterator position)
+  {
+		if(position.list != this || position.current == hashTable + capacity)
+			throw std::out_of_range("erase");
+		auto next = position;
+		++next;
+		auto bucket = position.current;
+		bucket->erase(position.iterator);
+		size--;
+		if(bucket->empty())
+			markEmpty(bucket - hashTable);
+		return iterator(next);
+  }
+
+  iterator erase(iterator position)
+  {
+		return erase(const_iterator(position));
+  }
+
+  size_type erase(const key_type& key)
+  {
+		auto hash = hashCode(key);
+		auto bucket = bucketOf(hash);
+		auto found = findInBucket(bucket, hash, key);
+		if(found == hashTable[bucket].end())
+			return 0;
+		hashTable[bucket].erase(found);
 		size--;
-		hashTable[makeHash(it->first)].remove(std::make_pair(it->first, it->second));
+		if(hashTable[bucket].empty())
+			markEmpty(bucket);
+		return 1;
+  }
+
+  // Only the buckets marked in the occupancy bitmap are visited, so clearing costs O(size).
+  void clear()
+  {
+		for(auto bucket = beginPos; bucket < capacity; bucket = nextOccupied(bucket + 1))
+			hashTable[bucket].clear();
+		std::fill(occupied.begin(), occupied.end(), 0);
+		size = 0;
+		beginPos = capacity;
   }
 
   size_type getSize() const
@@ -179,31 +858,52 @@ public:
     return size;
   }
 
+  size_type bucket_count() const
+  {
+		return capacity;
+  }
+
+  float load_factor() const
+  {
+		return static_cast<float>(size) / capacity;
+  }
+
+  float max_load_factor() const
+  {
+		return maxLoadFactor;
+  }
+
+  void max_load_factor(float ml)
+  {
+		if(!(ml > 0))
+			throw std::invalid_argument("max_load_factor");
+		maxLoadFactor = ml;
+		rebalance(size);
+  }
+
+  // Sets the bucket count to at least count (and enough for the current size at the maximum load
+  // factor). The table is not shrunk below this point until another rehash or reserve lowers it.
+  void rehash(size_type count)
+  {
+		reservedCapacity = BucketPolicy::bucketCount(std::max(count, minCapacity));
+		resize(BucketPolicy::bucketCount(std::max(reservedCapacity, bucketsFor(size))));
+  }
+
+  void reserve(size_type count)
+  {
+		rehash(bucketsFor(count));
+  }
+
   bool operator==(const HashMap& other) const
   {
 		if(size != other.size)
 			return false;
-    for(size_type i = 0;i < capacity;i++){
-			//if(hashTable[i] != other.hashTable[i]) return false;
-			bool found = false;
-			for(auto it = hashTable[i].begin(); it != hashTable[i].end(); ++it)
-			{
-				for(auto it2 = other.hashTable[i].begin(); it2 != other.hashTable[i].end(); ++it2)
-				{
-					if(*it == *it2)
-					{
-						found = true;
-						break;
-					}
-				}
-				if(found == false) return false;
-				found = false;
-			}
-
-			/*auto it = find(i);
-			auto it2 = other.find(i);
-			if((it == end() && it2 == other.end()) || (it != end() && it2 == other.end()) || (it == end() && it2 != other.end()) || (*it != *it2))
-				return false;*/
+		// bucket counts of the two maps may differ, so every entry is looked up in the other map
+		for(auto &&it: *this)
+		{
+			auto found = other.find(it.first);
+			if(found == other.end() || !(found->second == it.second))
+				return false;
 		}
 		return true;
   }
@@ -246,8 +946,8 @@ public:
   }
 };
 
-template <typename KeyType, typename ValueType>
-class HashMap<KeyType, ValueType>::ConstIterator
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator, typename BucketPolicy>
+class HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator, BucketPolicy>::ConstIterator
 {
 public:
   using reference = typename HashMap::const_reference;
@@ -256,32 +956,31 @@ public:
   using pointer = const typename HashMap::value_type*;
 
 private:
+	friend class HashMap;
 
-	HashMap<key_type, mapped_type > &list;
-	std::list<value_type> *current;
-	typename std::list<value_type>::iterator iterator;
+	HashMap *list;
+	Bucket *current;
+	typename Bucket::iterator iterator;
 
 public:
 
-  explicit ConstIterator():list()
+  explicit ConstIterator():list(nullptr), current(nullptr)
   {}
 
-	ConstIterator(HashMap<key_type, mapped_type > &list, std::list <value_type> *current, typename std::list<value_type>::iterator iterator)
-			:list(list), current(current), iterator(iterator){}
+	ConstIterator(HashMap &list, Bucket *current, typename Bucket::iterator iterator)
+			:list(&list), current(current), iterator(iterator){}
 
   ConstIterator(const ConstIterator& other):list(other.list),current(other.current),iterator(other.iterator) {}
 
+  ConstIterator& operator=(const ConstIterator& other) = default;
+
   ConstIterator& operator++()
   {
-		if(current == list.hashTable + list.capacity) throw std::out_of_range("op++");
+		if(current == list->hashTable + list->capacity) throw std::out_of_range("op++");
 		if(iterator == --(current->end()))
 		{
-			current++;
-			while((current != list.hashTable + list.capacity) && (current->empty()))
-			{
-				current++;
-			}
-			if(current == list.hashTable + list.capacity)
+			current = list->hashTable + list->nextOccupied(current - list->hashTable + 1);
+			if(current == list->hashTable + list->capacity)
 			{
 				iterator = ((current-1)->end());
 				return *this;
@@ -294,22 +993,19 @@ public:
 
   ConstIterator operator++(int)
   {
-    auto tmp = this;
+    auto tmp = *this;
 		++(*this);
-		return *tmp;
+		return tmp;
   }
 
   ConstIterator& operator--()
   {
-    if(((current == list.hashTable) && iterator == current->begin()) || ((unsigned)(current - list.hashTable) == list.beginPos))
-			throw std::out_of_range("op--");
-		if((iterator == current->begin()) || (current == list.hashTable + list.capacity))
+		if((current == list->hashTable + list->capacity) || (iterator == current->begin()))
 		{
-			current--;
-			while((current != list.hashTable) && (current->empty()))
-			{
-				current--;
-			}
+			auto previous = list->previousOccupied(current - list->hashTable);
+			if(previous == list->capacity)
+				throw std::out_of_range("op--");
+			current = list->hashTable + previous;
 			iterator = --(current->end());
 		}
 		else iterator--;
@@ -318,15 +1014,15 @@ public:
 
   ConstIterator operator--(int)
   {
-		auto tmp = this;
+		auto tmp = *this;
 		--(*this);
-		return *tmp;
+		return tmp;
   }
 
   reference operator*() const
   {
-    if(current == list.hashTable + list.capacity) throw std::out_of_range("op*");
-		return *iterator;
+    if(current == list->hashTable + list->capacity) throw std::out_of_range("op*");
+		return HashMap::entryValue(*iterator);
   }
 
   pointer operator->() const
@@ -345,8 +1041,9 @@ public:
   }
 };
 
-template <typename KeyType, typename ValueType>
-class HashMap<KeyType, ValueType>::Iterator : public HashMap<KeyType, ValueType>::ConstIterator
+template <typename KeyType, typename ValueType, typename Hash, typename KeyEqual, typename Allocator, typename BucketPolicy>
+class HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator, BucketPolicy>::Iterator
+		: public HashMap<KeyType, ValueType, Hash, KeyEqual, Allocator, BucketPolicy>::ConstIterator
 {
 public:
   using reference = typename HashMap::reference;
@@ -0,0 +1,216 @@
+#ifndef AISDI_MAPS_HASHING_H
+#define AISDI_MAPS_HASHING_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace aisdi
+{
+
+namespace hashing
+{
+	// Finalizer of MurmurHash3: every input bit affects every output bit
+	inline std::uint64_t fmix64(std::uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+#if defined(__SIZEOF_INT128__)
+	// __extension__ keeps -pedantic quiet about the compiler's own 128-bit type
+	__extension__ typedef unsigned __int128 uint128;
+#endif
+
+	inline std::size_t mix(std::size_t hash)
+	{
+		return static_cast<std::size_t>(fmix64(hash));
+	}
+
+	// A hasher whose output is already well distributed over all bits declares
+	// using is_avalanching = std::true_type; and the containers then skip their own mixing step.
+	template <typename Hash, typename = void>
+	struct isAvalanching : std::false_type
+	{};
+
+	template <typename Hash>
+	struct isAvalanching<Hash, std::void_t<typename Hash::is_avalanching>> : Hash::is_avalanching
+	{};
+
+	// HashMap stores the full hash code next to every entry when the hasher declares
+	// using cache_hash_code = std::true_type; or this trait is specialized for it.
+	template <typename Hash, typename = void>
+	struct cacheHashCode : std::false_type
+	{};
+
+	template <typename Hash>
+	struct cacheHashCode<Hash, std::void_t<typename Hash::cache_hash_code>> : Hash::cache_hash_code
+	{};
+
+	// A hasher or key comparison declaring using is_transparent = void; takes any type comparable with
+	// the key, so a std::string_view can be looked up without building a std::string.
+	template <typename T, typename = void>
+	struct isTransparent : std::false_type
+	{};
+
+	template <typename T>
+	struct isTransparent<T, std::void_t<typename T::is_transparent>> : std::true_type
+	{};
+
+	inline std::uint64_t load64(const unsigned char *bytes)
+	{
+		std::uint64_t word;
+		std::memcpy(&word, bytes, sizeof(word));
+		return word;
+	}
+}
+
+// Hash for integral and enum keys. std::hash is the identity for these in libstdc++, which clusters
+// sequential or strided ids as soon as only some of the bits pick the bucket.
+template <typename T>
+struct IntegerHash
+{
+	static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "IntegerHash needs an integral key");
+	using is_avalanching = std::true_type;
+
+	std::size_t operator()(T value) const
+	{
+		return hashing::mix(static_cast<std::size_t>(value));
+	}
+};
+
+// MurmurHash64A over the bytes of a string. Hashes std::string, std::string_view and C strings alike,
+// so with std::equal_to<> as KeyEqual a map of std::string is searched by any of them.
+struct StringHash
+{
+	using is_avalanching = std::true_type;
+	using is_transparent = void;
+
+	std::size_t operator()(std::string_view text) const
+	{
+		constexpr std::uint64_t m = 0xc6a4a7935bd1e995ULL;
+		constexpr int r = 47;
+		auto bytes = reinterpret_cast<const unsigned char*>(text.data());
+		auto length = text.size();
+		std::uint64_t h = seed ^ (length * m);
+		for(; length >= 8; bytes += 8, length -= 8)
+		{
+			auto k = hashing::load64(bytes);
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+			h ^= k;
+			h *= m;
+		}
+		if(length > 0)
+		{
+			std::uint64_t tail = 0;
+			std::memcpy(&tail, bytes, length);
+			h ^= tail;
+			h *= m;
+		}
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+		return static_cast<std::size_t>(h);
+	}
+
+private:
+	static constexpr std::uint64_t seed = 0x9e3779b97f4a7c15ULL;
+};
+
+// Opts any hasher into cached hash codes, e.g. HashMap<std::string, V, CachedHash<StringHash>>.
+// Worth it when comparing or hashing keys is expensive, like for long strings.
+template <typename Hash>
+struct CachedHash : Hash
+{
+	using cache_hash_code = std::true_type;
+};
+
+// Bucket index policies of HashMap. bucketCount rounds a requested count up to one the policy supports,
+// index maps a hash to [0, bucketCount). Policies that only look at some of the bits of the hash
+// ask for it to be mixed first, unless the hasher is avalanching already.
+
+// Prime bucket counts and a modulo. Uses every bit of the hash, at the price of an integer division.
+struct PrimeModuloPolicy
+{
+	static constexpr std::size_t minBucketCount = 11;
+	static constexpr bool needsMixing = false;
+
+	static std::size_t bucketCount(std::size_t count)
+	{
+		// roughly doubling primes, so growing the table keeps the amortized cost of an insert constant
+		static constexpr std::size_t primes[] = {11, 23, 47, 97, 197, 397, 797, 1597, 3203, 6421, 12853, 25717,
+			51437, 102877, 205759, 411527, 823117, 1646237, 3292489, 6584983, 13169977, 26339969, 52679969,
+			105359939, 210719881, 421439783, 842879579, 1685759167, 3371518343};
+		for(auto prime: primes)
+			if(prime >= count)
+				return prime;
+		return count | 1;
+	}
+
+	static std::size_t index(std::size_t hash, std::size_t bucketCount)
+	{
+		return hash % bucketCount;
+	}
+};
+
+// Power-of-two bucket counts and a mask of the low bits.
+struct PowerOfTwoPolicy
+{
+	static constexpr std::size_t minBucketCount = 8;
+	static constexpr bool needsMixing = true;
+
+	static std::size_t bucketCount(std::size_t count)
+	{
+		std::size_t rounded = minBucketCount;
+		while(rounded < count)
+			rounded *= 2;
+		return rounded;
+	}
+
+	static std::size_t index(std::size_t hash, std::size_t bucketCount)
+	{
+		return hash & (bucketCount - 1);
+	}
+};
+
+// Lemire's fast range: the high half of hash * bucketCount. Any bucket count works and there is no
+// division, but the index comes from the high bits of the hash.
+struct FastRangePolicy
+{
+	static constexpr std::size_t minBucketCount = 8;
+	static constexpr bool needsMixing = true;
+
+	static std::size_t bucketCount(std::size_t count)
+	{
+		return count < minBucketCount ? minBucketCount : count;
+	}
+
+	static std::size_t index(std::size_t hash, std::size_t bucketCount)
+	{
+#if defined(__SIZEOF_INT128__)
+		if(sizeof(std::size_t) == 8)
+			return static_cast<std::size_t>((static_cast<hashing::uint128>(hash) * bucketCount) >> 64);
+#endif
+		if(sizeof(std::size_t) <= 4)
+			return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * bucketCount) >> 32);
+		// portable 64x64 high product
+		std::uint64_t a = hash, b = bucketCount;
+		std::uint64_t aLow = a & 0xffffffffu, aHigh = a >> 32, bLow = b & 0xffffffffu, bHigh = b >> 32;
+		std::uint64_t low = aLow * bLow, middle1 = aHigh * bLow, middle2 = aLow * bHigh;
+		std::uint64_t carry = ((low >> 32) + (middle1 & 0xffffffffu) + (middle2 & 0xffffffffu)) >> 32;
+		return static_cast<std::size_t>(aHigh * bHigh + (middle1 >> 32) + (middle2 >> 32) + carry);
+	}
+};
+
+}
+
+#endif /* AISDI_MAPS_HASHING_H */
@@ -0,0 +1,216 @@
+#ifndef AISDI_MAPS_MAPPEDHASHMAP_H
+#define AISDI_MAPS_MAPPEDHASHMAP_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+
+namespace aisdi
+{
+
+// Read-only view of an image written by HashMap::save. The file is mapped into memory and searched
+// where it lies, so opening it costs the same for any size, and pages are read in as lookups touch
+// them. Key, value and hasher types must be the ones the image was saved with.
+// Iterators are pointers to the entries, which follow each other in bucket order.
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+		typename KeyEqual = std::equal_to<KeyType>>
+class MappedHashMap
+{
+public:
+  using key_type = KeyType;
+  using mapped_type = ValueType;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using const_reference = const value_type&;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using const_iterator = const value_type*;
+  using iterator = const_iterator;
+private:
+	Hash hashFunction;
+	KeyEqual keyEqual;
+	void *mapping = nullptr;
+	size_type mappingSize = 0;
+	const snapshot::Header *header = nullptr;
+	const std::uint64_t *starts = nullptr;
+	const value_type *entries = nullptr;
+
+	void unmap()
+	{
+		if(mapping != nullptr)
+			munmap(mapping, mappingSize);
+		mapping = nullptr;
+	}
+	// Everything the lookups rely on is checked, so a truncated or foreign file is refused instead of
+	// read out of bounds.
+	bool isValid() const
+	{
+		if(mappingSize < sizeof(snapshot::Header))
+			return false;
+		if(std::memcmp(header->magic, snapshot::magic, sizeof(snapshot::magic)) != 0
+				|| header->version != snapshot::version || header->byteOrder != snapshot::byteOrder
+				|| header->entrySize != sizeof(value_type) || header->entryAlignment != alignof(value_type))
+			return false;
+		auto bucketCount = header->bucketCount;
+		if(bucketCount == 0 || (bucketCount & (bucketCount - 1)) != 0 || bucketCount > mappingSize)
+			return false;
+		if(header->bucketsOffset % alignof(std::uint64_t) != 0 || header->entriesOffset % alignof(value_type) != 0
+				|| header->bucketsOffset > mappingSize
+				|| header->bucketsOffset +(bucketCount + 1) * sizeof(std::uint64_t) > mappingSize
+				|| header->size > mappingSize / sizeof(value_type)
+				|| header->entriesOffset > mappingSize - header->size * sizeof(value_type))
+			return false;
+		auto first = reinterpret_cast<const std::uint64_t*>(static_cast<const char*>(mapping) + header->bucketsOffset);
+		for(std::uint64_t i = 0; i < bucketCount; i++)
+			if(first[i] > first[i + 1])
+				return false;
+		return first[0] == 0 && first[bucketCount] == header->size;
+	}
+	const value_type* findEntry(const key_type& key) const
+	{
+		auto bucket = snapshot::bucketOf<Hash>(hashFunction(key), header->bucketCount);
+		for(auto i = starts[bucket]; i < starts[bucket + 1]; i++)
+			if(keyEqual(entries[i].first, key))
+				return entries + i;
+		return nullptr;
+	}
+public:
+  // Maps the image at path. Throws std::runtime_error when it cannot be opened or is not an image of
+  // this map type.
+  explicit MappedHashMap(const std::string& path, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual())
+		: hashFunction(hash), keyEqual(equal)
+  {
+		int file = open(path.c_str(), O_RDONLY);
+		if(file < 0)
+			throw std::runtime_error("MappedHashMap: cannot open " + path);
+		struct stat status;
+		if(fstat(file, &status) != 0 || status.st_size <= 0)
+		{
+			close(file);
+			throw std::runtime_error("MappedHashMap: not a snapshot: " + path);
+		}
+		mappingSize = static_cast<size_type>(status.st_size);
+		mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+		if(mapping == MAP_FAILED)
+		{
+			mapping = nullptr;
+			throw std::runtime_error("MappedHashMap: cannot map " + path);
+		}
+		header = static_cast<const snapshot::Header*>(mapping);
+		if(!isValid())
+		{
+			unmap();
+			throw std::runtime_error("MappedHashMap: not a snapshot: " + path);
+		}
+		auto bytes = static_cast<const char*>(mapping);
+		starts = reinterpret_cast<const std::uint64_t*>(bytes + header->bucketsOffset);
+		entries = reinterpret_cast<const value_type*>(bytes + header->entriesOffset);
+  }
+
+  MappedHashMap(const MappedHashMap&) = delete;
+  MappedHashMap& operator=(const MappedHashMap&) = delete;
+
+  MappedHashMap(MappedHashMap&& other)
+		: hashFunction(other.hashFunction), keyEqual(other.keyEqual), mapping(other.mapping),
+			mappingSize(other.mappingSize), header(other.header), starts(other.starts), entries(other.entries)
+  {
+		other.mapping = nullptr;
+  }
+
+  MappedHashMap& operator=(MappedHashMap&& other)
+  {
+		if(this == &other)
+			return *this;
+		unmap();
+		hashFunction = other.hashFunction;
+		keyEqual = other.keyEqual;
+		mapping = other.mapping;
+		mappingSize = other.mappingSize;
+		header = other.header;
+		starts = other.starts;
+		entries = other.entries;
+		other.mapping = nullptr;
+		return *this;
+  }
+
+  ~MappedHashMap()
+  {
+		unmap();
+  }
+
+  size_type getSize() const
+  {
+		return mapping == nullptr ? 0 : header->size;
+  }
+
+  bool isEmpty() const
+  {
+		return getSize() == 0;
+  }
+
+  size_type bucket_count() const
+  {
+		return mapping == nullptr ? 0 : header->bucketCount;
+  }
+
+  const_iterator find(const key_type& key) const
+  {
+		auto entry = mapping == nullptr ? nullptr : findEntry(key);
+		return entry != nullptr ? entry : end();
+  }
+
+  bool contains(const key_type& key) const
+  {
+		return mapping != nullptr && findEntry(key) != nullptr;
+  }
+
+  // The value of key, or nullptr when it is missing.
+  const mapped_type* get_if(const key_type& key) const
+  {
+		auto entry = mapping == nullptr ? nullptr : findEntry(key);
+		return entry != nullptr ? &entry->second : nullptr;
+  }
+
+  const mapped_type& valueOf(const key_type& key) const
+  {
+		auto value = get_if(key);
+		if(value == nullptr)
+			throw std::out_of_range("valueof");
+		return *value;
+  }
+
+  const_iterator begin() const
+  {
+		return entries;
+  }
+
+  const_iterator end() const
+  {
+		return mapping == nullptr ? entries : entries + header->size;
+  }
+
+  const_iterator cbegin() const
+  {
+		return begin();
+  }
+
+  const_iterator cend() const
+  {
+		return end();
+  }
+};
+
+}
+
+#endif /* AISDI_MAPS_MAPPEDHASHMAP_H */
@@ -0,0 +1,89 @@
+#ifndef AISDI_MAPS_PARALLEL_H
+#define AISDI_MAPS_PARALLEL_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace aisdi
+{
+
+// Threads for the bulk operations of the maps. Threads are started per call and joined before it
+// returns, so nothing outlives the container that started them.
+namespace parallel
+{
+	// Fewer elements per thread do not pay for starting it.
+	constexpr std::size_t minSlice = 16384;
+
+	inline unsigned defaultThreads()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Up to threads threads, but no more than elements fill.
+	inline unsigned threadsFor(std::size_t elements, unsigned threads)
+	{
+		return static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threads, elements / minSlice)));
+	}
+
+	// Runs task(0) to task(count - 1), all but the first on threads of their own, and rethrows the
+	// first exception a task threw.
+	template <typename Task>
+	void run(unsigned count, Task task)
+	{
+		std::vector<std::exception_ptr> errors(count);
+		auto attempt = [&](unsigned i) {
+			try
+			{
+				task(i);
+			}
+			catch(...)
+			{
+				errors[i] = std::current_exception();
+			}
+		};
+		std::vector<std::thread> workers;
+		try
+		{
+			for(unsigned i = 1; i < count; i++)
+				workers.emplace_back(attempt, i);
+		}
+		catch(...)
+		{
+			for(auto &&worker: workers)
+				worker.join();
+			throw;
+		}
+		attempt(0);
+		for(auto &&worker: workers)
+			worker.join();
+		for(auto &&error: errors)
+			if(error)
+				std::rethrow_exception(error);
+	}
+
+	// Runs chunk(0) to chunk(chunks - 1) on up to threads threads. A thread that finishes a chunk takes
+	// the next one left, so a few slow chunks do not hold up the others.
+	template <typename Chunk>
+	void forEachChunk(std::size_t chunks, unsigned threads, Chunk chunk)
+	{
+		std::atomic<std::size_t> next{0};
+		threads = static_cast<unsigned>(std::max<std::size_t>(1, std::min<std::size_t>(threads, chunks)));
+		run(threads, [&](unsigned) {
+			for(auto i = next++; i < chunks; i = next++)
+				chunk(i);
+		});
+	}
+
+	// Number of chunks to cut a container into for threads threads, enough to even out their loads.
+	inline std::size_t chunksFor(unsigned threads)
+	{
+		return std::size_t(8) * std::max(1u, threads);
+	}
+}
+
+}
+
+#endif /* AISDI_MAPS_PARALLEL_H */
@@ -0,0 +1,529 @@
+#ifndef AISDI_MAPS_PERSISTENTTREEMAP_H
+#define AISDI_MAPS_PERSISTENTTREEMAP_H
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+#include <iterator>
+#include <memory>
+#include <tuple>
+
+namespace aisdi {
+
+	namespace persistent {
+		// An AVL tree of height 90 has more than 2^62 nodes, more than fit in memory.
+		constexpr std::size_t maxHeight = 90;
+	}
+
+	// Ordered map whose copies share their nodes. Copying is O(1): the copy takes a reference to the
+	// root. A mutation copies the nodes on the path to the changed key that are still shared with a
+	// copy, O(log n) of them, and changes unshared nodes in place, so a map that was never copied does
+	// not copy at all. Every copy is an independent snapshot and different copies may be used from
+	// different threads; the allocator has to allow freeing a node from any of them.
+	// Nodes have no parent pointers, which sharing rules out, so the tree is kept AVL-balanced with
+	// rotations on the copied path and iterators carry their path from the root. The elements are
+	// only changed through the map, iterators are read-only.
+	template<typename KeyType, typename ValueType, typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
+	class PersistentTreeMap {
+	public:
+		using key_type = KeyType;
+		using mapped_type = ValueType;
+		using value_type = std::pair<const key_type, mapped_type>;
+		using size_type = std::size_t;
+		using reference = value_type &;
+		using const_reference = const value_type &;
+		using allocator_type = Allocator;
+
+		class ConstIterator;
+
+		using iterator = ConstIterator;
+		using const_iterator = ConstIterator;
+	private:
+
+		class Node {
+		public:
+			value_type value;
+			Node *left = nullptr, *right = nullptr;
+			std::atomic<size_type> references{1};
+			unsigned char height = 1;
+
+			template<typename... Args>
+			explicit Node(std::in_place_t, Args &&... args) : value(std::forward<Args>(args)...) {}
+
+			// The copy shares the children of node, the caller takes the references to them.
+			Node(const Node *node) : value(node->value), left(node->left), right(node->right), height(node->height) {}
+		};
+
+		using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+		using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+		NodeAllocator allocator;
+		size_type size = 0;
+		Node *root = nullptr;
+
+		template<typename... Args>
+		Node *createNode(Args &&... args) {
+			auto node = NodeTraits::allocate(allocator, 1);
+			try {
+				NodeTraits::construct(allocator, node, std::forward<Args>(args)...);
+			} catch (...) {
+				NodeTraits::deallocate(allocator, node, 1);
+				throw;
+			}
+			return node;
+		}
+
+		static Node *retain(Node *node) {
+			if (node != nullptr)
+				node->references.fetch_add(1, std::memory_order_relaxed);
+			return node;
+		}
+
+		// Drops a reference and frees the node, and what only it referenced, with the last one.
+		void release(Node *node) {
+			if (node == nullptr || node->references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				return;
+			release(node->left);
+			release(node->right);
+			NodeTraits::destroy(allocator, node);
+			NodeTraits::deallocate(allocator, node, 1);
+		}
+
+		// Makes slot refer to a node no other map can see, copying it if it is shared. Only this map
+		// holds a node with a single reference, so nobody can start sharing it meanwhile.
+		void unshare(Node *&slot) {
+			if (slot->references.load(std::memory_order_acquire) == 1)
+				return;
+			auto copy = createNode(static_cast<const Node *>(slot));
+			retain(copy->left);
+			retain(copy->right);
+			release(slot);
+			slot = copy;
+		}
+
+		static int heightOf(const Node *node) {
+			return node == nullptr ? 0 : node->height;
+		}
+
+		static void updateHeight(Node *node) {
+			node->height = 1 + std::max(heightOf(node->left), heightOf(node->right));
+		}
+
+		// Rotations move references between links without changing any count. slot is unshared.
+		void rotateLeft(Node *&slot) {
+			unshare(slot->right);
+			auto x = slot, y = slot->right;
+			x->right = y->left;
+			y->left = x;
+			slot = y;
+			updateHeight(x);
+			updateHeight(y);
+		}
+
+		void rotateRight(Node *&slot) {
+			unshare(slot->left);
+			auto x = slot, y = slot->left;
+			x->left = y->right;
+			y->right = x;
+			slot = y;
+			updateHeight(x);
+			updateHeight(y);
+		}
+
+		// Restores the AVL condition at an unshared node whose subtrees differ in height by at most two.
+		// Returns whether the height of the subtree changed.
+		bool rebalance(Node *&slot) {
+			int before = slot->height;
+			int balance = heightOf(slot->left) - heightOf(slot->right);
+			if (balance > 1) {
+				unshare(slot->left);
+				if (heightOf(slot->left->left) < heightOf(slot->left->right))
+					rotateLeft(slot->left);
+				rotateRight(slot);
+			} else if (balance < -1) {
+				unshare(slot->right);
+				if (heightOf(slot->right->right) < heightOf(slot->right->left))
+					rotateRight(slot->right);
+				rotateLeft(slot);
+			} else
+				updateHeight(slot);
+			return slot->height != before;
+		}
+
+		// Rebalances the subtrees in path, bottom up, until one keeps its height.
+		void rebalancePath(Node **path[], size_type depth) {
+			while (depth > 0 && rebalance(*path[--depth]))
+				;
+		}
+
+		const Node *findNode(const key_type &key) const {
+			auto tmp = root;
+			while (tmp != nullptr) {
+				if (tmp->value.first == key)
+					return tmp;
+				if (tmp->value.first < key)
+					tmp = tmp->right;
+				else tmp = tmp->left;
+			}
+			return nullptr;
+		}
+
+		// Unshares the path to key and returns its node, with inserted set, after creating the node
+		// from args when the key was absent.
+		template<typename K, typename... Args>
+		Node *emplaceNode(bool &inserted, K &&key, Args &&... args) {
+			Node **path[persistent::maxHeight];
+			size_type depth = 0;
+			auto slot = &root;
+			while (*slot != nullptr) {
+				unshare(*slot);
+				if ((*slot)->value.first == key) {
+					inserted = false;
+					return *slot;
+				}
+				path[depth++] = slot;
+				slot = key < (*slot)->value.first ? &(*slot)->left : &(*slot)->right;
+			}
+			auto node = createNode(std::in_place, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+														 std::forward_as_tuple(std::forward<Args>(args)...));
+			*slot = node;
+			size++;
+			rebalancePath(path, depth);
+			inserted = true;
+			return node;
+		}
+
+		template<typename K, typename... Args>
+		bool tryEmplace(K &&key, Args &&... args) {
+			// an existing key must not cost the copy of its path
+			if (findNode(key) != nullptr)
+				return false;
+			bool inserted;
+			emplaceNode(inserted, std::forward<K>(key), std::forward<Args>(args)...);
+			return inserted;
+		}
+
+		template<typename K, typename M>
+		bool insertOrAssign(K &&key, M &&obj) {
+			bool inserted;
+			auto node = emplaceNode(inserted, std::forward<K>(key), std::forward<M>(obj));
+			// obj is only consumed when a new node was built from it
+			if (!inserted)
+				node->value.second = std::forward<M>(obj);
+			return inserted;
+		}
+
+		void removeNode(const key_type &key) {
+			Node **path[persistent::maxHeight];
+			size_type depth = 0;
+			auto slot = &root;
+			for (;;) {
+				unshare(*slot);
+				if ((*slot)->value.first == key)
+					break;
+				path[depth++] = slot;
+				slot = key < (*slot)->value.first ? &(*slot)->left : &(*slot)->right;
+			}
+			auto z = *slot;
+			if (z->left == nullptr || z->right == nullptr) {
+				*slot = z->left != nullptr ? z->left : z->right;
+			} else {
+				// the successor takes the place of z, its subtree and the path down to it shrink
+				auto zDepth = depth;
+				path[depth++] = slot;
+				auto successor = &z->right;
+				unshare(*successor);
+				while ((*successor)->left != nullptr) {
+					path[depth++] = successor;
+					successor = &(*successor)->left;
+					unshare(*successor);
+				}
+				auto y = *successor;
+				*successor = y->right;
+				y->left = z->left;
+				y->right = z->right;
+				y->height = z->height;
+				*slot = y;
+				if (depth > zDepth + 1)
+					path[zDepth + 1] = &y->right;
+			}
+			z->left = z->right = nullptr;
+			release(z);
+			size--;
+			rebalancePath(path, depth);
+		}
+
+	public:
+		PersistentTreeMap() = default;
+
+		explicit PersistentTreeMap(const Allocator &allocator) : allocator(allocator) {}
+
+		~PersistentTreeMap() {
+			release(root);
+		}
+
+		PersistentTreeMap(std::initializer_list<value_type> list) {
+			for (auto &&it : list)
+				insertOrAssign(it.first, it.second);
+		}
+
+		template<typename InputIt>
+		PersistentTreeMap(InputIt first, InputIt last) {
+			for (; first != last; ++first)
+				tryEmplace(first->first, first->second);
+		}
+
+		// Shares every node with other. The allocator is copied as it is, since either map may be the
+		// one to free a shared node.
+		PersistentTreeMap(const PersistentTreeMap &other)
+				: allocator(other.allocator), size(other.size), root(retain(other.root)) {}
+
+		PersistentTreeMap(PersistentTreeMap &&other) : allocator(other.allocator), size(other.size), root(other.root) {
+			other.root = nullptr;
+			other.size = 0;
+		}
+
+		PersistentTreeMap &operator=(const PersistentTreeMap &other) {
+			retain(other.root);
+			release(root);
+			allocator = other.allocator;
+			root = other.root;
+			size = other.size;
+			return *this;
+		}
+
+		PersistentTreeMap &operator=(PersistentTreeMap &&other) {
+			if (this == &other)
+				return *this;
+			release(root);
+			allocator = other.allocator;
+			root = other.root;
+			size = other.size;
+			other.root = nullptr;
+			other.size = 0;
+			return *this;
+		}
+
+		allocator_type get_allocator() const {
+			return allocator_type(allocator);
+		}
+
+		bool isEmpty() const {
+			return size == 0;
+		}
+
+		size_type getSize() const {
+			return size;
+		}
+
+		// Constructs the value from args only when key is absent. Returns whether it inserted.
+		template<typename... Args>
+		bool try_emplace(const key_type &key, Args &&... args) {
+			return tryEmplace(key, std::forward<Args>(args)...);
+		}
+
+		template<typename... Args>
+		bool try_emplace(key_type &&key, Args &&... args) {
+			return tryEmplace(std::move(key), std::forward<Args>(args)...);
+		}
+
+		// Returns true when the key was inserted, false when an existing value was assigned.
+		template<typename M>
+		bool insert_or_assign(const key_type &key, M &&obj) {
+			return insertOrAssign(key, std::forward<M>(obj));
+		}
+
+		template<typename M>
+		bool insert_or_assign(key_type &&key, M &&obj) {
+			return insertOrAssign(std::move(key), std::forward<M>(obj));
+		}
+
+		const mapped_type &valueOf(const key_type &key) const {
+			auto node = findNode(key);
+			if (node == nullptr)
+				throw std::out_of_range("valueof");
+			return node->value.second;
+		}
+
+		bool contains(const key_type &key) const {
+			return findNode(key) != nullptr;
+		}
+
+		const_iterator find(const key_type &key) const {
+			const_iterator it(root);
+			for (auto tmp = root; tmp != nullptr;) {
+				it.path[it.depth++] = tmp;
+				if (tmp->value.first == key)
+					return it;
+				if (tmp->value.first < key)
+					tmp = tmp->right;
+				else tmp = tmp->left;
+			}
+			return cend();
+		}
+
+		size_type erase(const key_type &key) {
+			if (findNode(key) == nullptr)
+				return 0;
+			removeNode(key);
+			return 1;
+		}
+
+		void remove(const key_type &key) {
+			if (erase(key) == 0)
+				throw std::out_of_range("remove");
+		}
+
+		bool operator==(const PersistentTreeMap &other) const {
+			if (size != other.size) return false;
+			if (root == other.root) return true;
+			auto it = begin();
+			for (auto it2 = other.begin(); it2 != other.end(); ++it2) {
+				if ((it->first != it2->first) || (it->second != it2->second))
+					return false;
+				++it;
+			}
+			return true;
+		}
+
+		bool operator!=(const PersistentTreeMap &other) const {
+			return !(*this == other);
+		}
+
+		const_iterator cbegin() const {
+			const_iterator it(root);
+			for (auto tmp = root; tmp != nullptr; tmp = tmp->left)
+				it.path[it.depth++] = tmp;
+			return it;
+		}
+
+		const_iterator cend() const {
+			return const_iterator(root);
+		}
+
+		const_iterator begin() const {
+			return cbegin();
+		}
+
+		const_iterator end() const {
+			return cend();
+		}
+	};
+
+	// Holds the nodes from the root to the current one, which stands in for the parent pointers. The
+	// end iterator has an empty path.
+	template<typename KeyType, typename ValueType, typename Allocator>
+	class PersistentTreeMap<KeyType, ValueType, Allocator>::ConstIterator {
+	public:
+		using reference = typename PersistentTreeMap::const_reference;
+		using iterator_category = std::bidirectional_iterator_tag;
+		using value_type = typename PersistentTreeMap::value_type;
+		using pointer = const typename PersistentTreeMap::value_type *;
+
+	private:
+		friend class PersistentTreeMap;
+
+		const Node *root = nullptr;
+		const Node *path[persistent::maxHeight];
+		size_type depth = 0;
+
+		explicit ConstIterator(const Node *root) : root(root) {}
+
+		void pushLeftmost(const Node *node) {
+			for (; node != nullptr; node = node->left)
+				path[depth++] = node;
+		}
+
+		void pushRightmost(const Node *node) {
+			for (; node != nullptr; node = node->right)
+				path[depth++] = node;
+		}
+
+		const Node *current() const {
+			return depth == 0 ? nullptr : path[depth - 1];
+		}
+
+	public:
+		explicit ConstIterator() {}
+
+		ConstIterator(const ConstIterator &other) : root(other.root), depth(other.depth) {
+			std::copy(other.path, other.path + depth, path);
+		}
+
+		ConstIterator &operator=(const ConstIterator &other) {
+			root = other.root;
+			depth = other.depth;
+			std::copy(other.path, other.path + depth, path);
+			return *this;
+		}
+
+		ConstIterator &operator++() {
+			if (depth == 0)
+				throw std::out_of_range("++op");
+			auto node = path[depth - 1];
+			if (node->right != nullptr) {
+				pushLeftmost(node->right);
+				return *this;
+			}
+			// climb while coming from a right child
+			while (--depth > 0 && path[depth - 1]->right == node)
+				node = path[depth - 1];
+			return *this;
+		}
+
+		ConstIterator operator++(int) {
+			auto tmp = *this;
+			++(*this);
+			return tmp;
+		}
+
+		ConstIterator &operator--() {
+			if (depth == 0) {
+				if (root == nullptr) throw std::out_of_range("op--");
+				pushRightmost(root);
+				return *this;
+			}
+			auto node = path[depth - 1];
+			if (node->left != nullptr) {
+				pushRightmost(node->left);
+				return *this;
+			}
+			auto level = depth - 1;
+			while (level > 0 && path[level - 1]->left == node)
+				node = path[--level];
+			if (level == 0) throw std::out_of_range("op--");
+			depth = level;
+			return *this;
+		}
+
+		ConstIterator operator--(int) {
+			auto tmp = *this;
+			--(*this);
+			return tmp;
+		}
+
+		reference operator*() const {
+			if (depth == 0)
+				throw std::out_of_range("op*");
+			return path[depth - 1]->value;
+		}
+
+		pointer operator->() const {
+			return &this->operator*();
+		}
+
+		bool operator==(const ConstIterator &other) const {
+			return current() == other.current();
+		}
+
+		bool operator!=(const ConstIterator &other) const {
+			return !(*this == other);
+		}
+	};
+
+}
+
+#endif /* AISDI_MAPS_PERSISTENTTREEMAP_H */
@@ -0,0 +1,393 @@
+#ifndef AISDI_MAPS_RCUHASHMAP_H
+#define AISDI_MAPS_RCUHASHMAP_H
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "Epoch.h"
+#include "Hashing.h"
+
+namespace aisdi
+{
+
+// Chained hash map for read-mostly workloads shared between threads. Readers take no lock and do no
+// atomic read-modify-write: they only load pointers inside an epoch guard. Writers are serialized by
+// a mutex and never change a node a reader may see. They publish a new node, bucket or whole table
+// with a single atomic pointer store and retire what it replaced to the epoch domain, see Epoch.h.
+// Assigning a value replaces its node and growing the table copies every entry, which is the price
+// of lock-free reads. Reads return copies or run a callback on the entry, as in ConcurrentHashMap.
+template <typename KeyType, typename ValueType, typename Hash = std::hash<KeyType>,
+		typename KeyEqual = std::equal_to<KeyType>,
+		typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+		typename BucketPolicy = PrimeModuloPolicy>
+class RcuHashMap
+{
+public:
+  using key_type = KeyType;
+  using mapped_type = ValueType;
+  using value_type = std::pair<const key_type, mapped_type>;
+  using size_type = std::size_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+private:
+	static constexpr size_type minCapacity = BucketPolicy::minBucketCount;
+	static constexpr size_type minReclaim = 64;
+
+	struct Node
+	{
+		value_type value;
+		std::atomic<Node*> next;
+
+		template <typename... Args>
+		explicit Node(Node *next, Args&&... args) : value(std::forward<Args>(args)...), next(next)
+		{}
+	};
+	struct Table
+	{
+		size_type capacity;
+		std::unique_ptr<std::atomic<Node*>[]> buckets;
+
+		explicit Table(size_type capacity) : capacity(capacity), buckets(new std::atomic<Node*>[capacity])
+		{
+			for(size_type i = 0; i < capacity; i++)
+				buckets[i].store(nullptr, std::memory_order_relaxed);
+		}
+	};
+
+	using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+	using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+	Hash hashFunction;
+	KeyEqual keyEqual;
+	NodeAllocator allocator;
+	std::atomic<Table*> table;
+	std::atomic<size_type> size{0};
+	std::mutex writeLock;
+	// guarded by writeLock
+	std::vector<std::pair<Node*, std::uint64_t>> retiredNodes;
+	std::vector<std::pair<Table*, std::uint64_t>> retiredTables;
+	size_type reclaimAt = minReclaim;
+
+	size_type hashCode(const key_type& key) const
+	{
+		auto hash = hashFunction(key);
+		if(BucketPolicy::needsMixing && !hashing::isAvalanching<Hash>::value)
+			hash = hashing::mix(hash);
+		return hash;
+	}
+	template <typename... Args>
+	Node *createNode(Node *next, Args&&... args)
+	{
+		auto node = NodeTraits::allocate(allocator, 1);
+		try
+		{
+			NodeTraits::construct(allocator, node, next, std::forward<Args>(args)...);
+		}
+		catch(...)
+		{
+			NodeTraits::deallocate(allocator, node, 1);
+			throw;
+		}
+		return node;
+	}
+	void destroyNode(Node *node)
+	{
+		NodeTraits::destroy(allocator, node);
+		NodeTraits::deallocate(allocator, node, 1);
+	}
+	void destroyTable(Table *dead)
+	{
+		for(size_type i = 0; i < dead->capacity; i++)
+		{
+			for(auto node = dead->buckets[i].load(std::memory_order_relaxed); node != nullptr;)
+			{
+				auto next = node->next.load(std::memory_order_relaxed);
+				destroyNode(node);
+				node = next;
+			}
+		}
+		delete dead;
+	}
+	// Reader side: the node holding key in the table published last, or nullptr.
+	const Node *lookup(const key_type& key) const
+	{
+		auto current = table.load(std::memory_order_acquire);
+		auto &bucket = current->buckets[BucketPolicy::index(hashCode(key), current->capacity)];
+		for(auto node = bucket.load(std::memory_order_acquire); node != nullptr;
+				node = node->next.load(std::memory_order_acquire))
+			if(keyEqual(node->value.first, key))
+				return node;
+		return nullptr;
+	}
+	// Writer side: the link pointing at the node holding key, or the null link ending its bucket.
+	std::atomic<Node*> *findLink(const key_type& key)
+	{
+		auto current = table.load(std::memory_order_relaxed);
+		auto link = &current->buckets[BucketPolicy::index(hashCode(key), current->capacity)];
+		for(auto node = link->load(std::memory_order_relaxed); node != nullptr; node = link->load(std::memory_order_relaxed))
+		{
+			if(keyEqual(node->value.first, key))
+				return link;
+			link = &node->next;
+		}
+		return link;
+	}
+	// Readers of the old table keep walking its nodes, so the new one gets copies of them.
+	void grow(size_type elements)
+	{
+		auto current = table.load(std::memory_order_relaxed);
+		if(elements <= current->capacity)
+			return;
+		std::unique_ptr<Table> grown(new Table(BucketPolicy::bucketCount(std::max(current->capacity * 2, elements))));
+		try
+		{
+			for(size_type i = 0; i < current->capacity; i++)
+			{
+				for(auto node = current->buckets[i].load(std::memory_order_relaxed); node != nullptr;
+						node = node->next.load(std::memory_order_relaxed))
+				{
+					auto &bucket = grown->buckets[BucketPolicy::index(hashCode(node->value.first), grown->capacity)];
+					bucket.store(createNode(bucket.load(std::memory_order_relaxed), node->value), std::memory_order_relaxed);
+				}
+			}
+		}
+		catch(...)
+		{
+			destroyTable(grown.release());
+			throw;
+		}
+		table.store(grown.release(), std::memory_order_release);
+		retireTable(current);
+	}
+	void retireNode(Node *node)
+	{
+		retiredNodes.emplace_back(node, epoch::domain().current());
+		if(retiredNodes.size() >= reclaimAt)
+			reclaim();
+	}
+	void retireTable(Table *dead)
+	{
+		retiredTables.emplace_back(dead, epoch::domain().current());
+		reclaim();
+	}
+	void reclaim()
+	{
+		auto safe = epoch::domain().advance();
+		auto reclaimed = std::stable_partition(retiredNodes.begin(), retiredNodes.end(),
+				[safe](const std::pair<Node*, std::uint64_t>& retired) { return retired.second >= safe; });
+		std::for_each(reclaimed, retiredNodes.end(),
+				[this](const std::pair<Node*, std::uint64_t>& retired) { destroyNode(retired.first); });
+		retiredNodes.erase(reclaimed, retiredNodes.end());
+		auto reclaimedTables = std::stable_partition(retiredTables.begin(), retiredTables.end(),
+				[safe](const std::pair<Table*, std::uint64_t>& retired) { return retired.second >= safe; });
+		std::for_each(reclaimedTables, retiredTables.end(),
+				[this](const std::pair<Table*, std::uint64_t>& retired) { destroyTable(retired.first); });
+		retiredTables.erase(reclaimedTables, retiredTables.end());
+		// a long read keeps nodes alive, so do not rescan them on every write meanwhile
+		reclaimAt = std::max(minReclaim, 2 * retiredNodes.size());
+	}
+	// Links a new node for key in front of its bucket, or replaces the node already holding it.
+	template <typename K, typename... Args>
+	bool publish(K&& key, Args&&... args)
+	{
+		auto link = findLink(key);
+		auto found = link->load(std::memory_order_relaxed);
+		if(found != nullptr)
+		{
+			auto node = createNode(found->next.load(std::memory_order_relaxed), std::piecewise_construct,
+					std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+			link->store(node, std::memory_order_release);
+			retireNode(found);
+			return false;
+		}
+		grow(size.load(std::memory_order_relaxed) + 1);
+		auto current = table.load(std::memory_order_relaxed);
+		auto &bucket = current->buckets[BucketPolicy::index(hashCode(key), current->capacity)];
+		auto node = createNode(bucket.load(std::memory_order_relaxed), std::piecewise_construct,
+				std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+		bucket.store(node, std::memory_order_release);
+		size.store(size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return true;
+	}
+public:
+  explicit RcuHashMap(size_type bucketCount = minCapacity, const Hash& hash = Hash(), const KeyEqual& equal = KeyEqual(),
+		const Allocator& allocator = Allocator())
+		: hashFunction(hash), keyEqual(equal), allocator(allocator),
+			table(new Table(BucketPolicy::bucketCount(std::max(bucketCount, minCapacity))))
+  {}
+
+  // No reader may still be inside the map.
+  ~RcuHashMap()
+  {
+		for(auto &&retired: retiredNodes)
+			destroyNode(retired.first);
+		for(auto &&retired: retiredTables)
+			destroyTable(retired.first);
+		destroyTable(table.load(std::memory_order_relaxed));
+  }
+
+  RcuHashMap(const RcuHashMap&) = delete;
+  RcuHashMap& operator=(const RcuHashMap&) = delete;
+
+  hasher hash_function() const
+  {
+		return hashFunction;
+  }
+
+  key_equal key_eq() const
+  {
+		return keyEqual;
+  }
+
+  size_type getSize() const
+  {
+		return size.load(std::memory_order_relaxed);
+  }
+
+  bool isEmpty() const
+  {
+		return getSize() == 0;
+  }
+
+  size_type bucket_count() const
+  {
+		epoch::Guard guard;
+		return table.load(std::memory_order_acquire)->capacity;
+  }
+
+  std::optional<mapped_type> find(const key_type& key) const
+  {
+		epoch::Guard guard;
+		auto node = lookup(key);
+		if(node == nullptr)
+			return std::nullopt;
+		return node->value.second;
+  }
+
+  mapped_type valueOf(const key_type& key) const
+  {
+		auto value = find(key);
+		if(!value)
+			throw std::out_of_range("valueOf");
+		return *std::move(value);
+  }
+
+  bool contains(const key_type& key) const
+  {
+		epoch::Guard guard;
+		return lookup(key) != nullptr;
+  }
+
+  // Calls f(const mapped_type&) without copying the value. Returns false when the key is absent.
+  template <typename F>
+  bool visit(const key_type& key, F f) const
+  {
+		epoch::Guard guard;
+		auto node = lookup(key);
+		if(node == nullptr)
+			return false;
+		f(static_cast<const mapped_type&>(node->value.second));
+		return true;
+  }
+
+  // Calls f(const value_type&) for every element of the table published when it starts. Writers
+  // are not held up, and an element they insert or erase meanwhile may or may not be seen.
+  template <typename F>
+  void for_each(F f) const
+  {
+		epoch::Guard guard;
+		auto current = table.load(std::memory_order_acquire);
+		for(size_type i = 0; i < current->capacity; i++)
+			for(auto node = current->buckets[i].load(std::memory_order_acquire); node != nullptr;
+					node = node->next.load(std::memory_order_acquire))
+				f(static_cast<const value_type&>(node->value));
+  }
+
+  // Returns true when the key was inserted, false when an existing value was replaced.
+  template <typename M>
+  bool insert_or_assign(const key_type& key, M&& obj)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		return publish(key, std::forward<M>(obj));
+  }
+
+  template <typename M>
+  bool insert_or_assign(key_type&& key, M&& obj)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		return publish(std::move(key), std::forward<M>(obj));
+  }
+
+  // Inserts only when the key is absent. Returns true when it inserted.
+  template <typename... Args>
+  bool try_emplace(const key_type& key, Args&&... args)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		if(findLink(key)->load(std::memory_order_relaxed) != nullptr)
+			return false;
+		return publish(key, std::forward<Args>(args)...);
+  }
+
+  // Replaces the value of key by a copy that f(mapped_type&) modified. Returns false when the key
+  // is absent.
+  template <typename F>
+  bool update(const key_type& key, F f)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		auto found = findLink(key)->load(std::memory_order_relaxed);
+		if(found == nullptr)
+			return false;
+		mapped_type value(found->value.second);
+		f(value);
+		publish(key, std::move(value));
+		return true;
+  }
+
+  size_type erase(const key_type& key)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		auto link = findLink(key);
+		auto found = link->load(std::memory_order_relaxed);
+		if(found == nullptr)
+			return 0;
+		link->store(found->next.load(std::memory_order_relaxed), std::memory_order_release);
+		size.store(size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+		retireNode(found);
+		return 1;
+  }
+
+  void remove(const key_type& key)
+  {
+		if(erase(key) == 0)
+			throw std::out_of_range("remove");
+  }
+
+  void reserve(size_type elements)
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		grow(elements);
+  }
+
+  // Publishes an empty table, the old one is freed once its readers are done.
+  void clear()
+  {
+		std::lock_guard<std::mutex> lock(writeLock);
+		std::unique_ptr<Table> empty(new Table(BucketPolicy::bucketCount(minCapacity)));
+		auto current = table.exchange(empty.release(), std::memory_order_acq_rel);
+		size.store(0, std::memory_order_relaxed);
+		retireTable(current);
+  }
+};
+
+}
+
+#endif /* AISDI_MAPS_RCUHASHMAP_H */
@@ -0,0 +1,240 @@
+#ifndef AISDI_MAPS_SLABALLOCATOR_H
+#define AISDI_MAPS_SLABALLOCATOR_H
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+namespace aisdi
+{
+
+namespace slab
+{
+	// Chunks of a single size. New chunks are cut from the current slab by bumping a pointer, freed ones
+	// are threaded onto a free list and reused first. Slabs go back to the system only with the pool.
+	class Pool
+	{
+		struct FreeChunk
+		{
+			FreeChunk *next;
+		};
+
+		static constexpr std::size_t firstSlabChunks = 32;
+		static constexpr std::size_t maxSlabChunks = 4096;
+
+		std::size_t chunkSize;
+		std::size_t alignment;
+		std::size_t slabChunks = firstSlabChunks;
+		std::vector<void*> slabs;
+		FreeChunk *freeList = nullptr;
+		char *cursor = nullptr;
+		char *limit = nullptr;
+
+		void grow()
+		{
+			auto slab = static_cast<char*>(::operator new(slabChunks * chunkSize, std::align_val_t(alignment)));
+			slabs.push_back(slab);
+			cursor = slab;
+			limit = slab + slabChunks * chunkSize;
+			// slabs double in size, so a small container keeps a small footprint
+			if(slabChunks < maxSlabChunks)
+				slabChunks *= 2;
+		}
+		static std::size_t alignmentFor(std::size_t align)
+		{
+			return align < alignof(FreeChunk) ? alignof(FreeChunk) : align;
+		}
+		static std::size_t chunkSizeFor(std::size_t size, std::size_t align)
+		{
+			size = size < sizeof(FreeChunk) ? sizeof(FreeChunk) : size;
+			return (size + alignmentFor(align) - 1) / alignmentFor(align) * alignmentFor(align);
+		}
+	public:
+		Pool(std::size_t size, std::size_t align)
+			: chunkSize(chunkSizeFor(size, align)), alignment(alignmentFor(align))
+		{}
+
+		~Pool()
+		{
+			for(auto slab: slabs)
+				::operator delete(slab, std::align_val_t(alignment));
+		}
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		bool serves(std::size_t size, std::size_t align) const
+		{
+			return chunkSize == chunkSizeFor(size, align) && alignment == alignmentFor(align);
+		}
+
+		void *allocate()
+		{
+			if(freeList != nullptr)
+			{
+				auto chunk = freeList;
+				freeList = chunk->next;
+				return chunk;
+			}
+			if(cursor == limit)
+				grow();
+			auto chunk = cursor;
+			cursor += chunkSize;
+			return chunk;
+		}
+
+		void deallocate(void *chunk)
+		{
+			auto freed = static_cast<FreeChunk*>(chunk);
+			freed->next = freeList;
+			freeList = freed;
+		}
+	};
+
+	// Pools of one container. Allocators rebound to the container's different node types share the
+	// arena and each picks the pool for the size of its type. The reference count is a plain integer:
+	// like the containers, an arena is never used from two threads at once.
+	class Arena
+	{
+		std::vector<std::unique_ptr<Pool>> pools;
+		std::size_t references = 1;
+	public:
+		Pool &pool(std::size_t size, std::size_t align)
+		{
+			for(auto &&pool: pools)
+				if(pool->serves(size, align))
+					return *pool;
+			pools.emplace_back(new Pool(size, align));
+			return *pools.back();
+		}
+
+		static Arena *acquire(Arena *arena)
+		{
+			arena->references++;
+			return arena;
+		}
+
+		static void release(Arena *arena)
+		{
+			if(--arena->references == 0)
+				delete arena;
+		}
+
+		bool isShared() const
+		{
+			return references > 1;
+		}
+	};
+}
+
+// Fixed-size node allocator for the maps. Single objects come from per-size pools in an arena that
+// is shared by all copies and rebinds of the allocator, and released as a whole when the last of them
+// is destroyed. Array requests go straight to operator new. Copying a container gives the copy a fresh
+// arena, so every container has its own free lists. Not thread-safe, like the containers using it.
+template <typename T>
+class SlabAllocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::false_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+	using is_always_equal = std::false_type;
+
+	SlabAllocator() : arena(new slab::Arena)
+	{}
+
+	SlabAllocator(const SlabAllocator& other) noexcept : arena(slab::Arena::acquire(other.arena))
+	{}
+
+	template <typename U>
+	SlabAllocator(const SlabAllocator<U>& other) noexcept : arena(slab::Arena::acquire(other.arena))
+	{}
+
+	// there are no move operations: a moved-from allocator must still serve the container it belongs to
+	SlabAllocator& operator=(const SlabAllocator& other) noexcept
+	{
+		auto previous = arena;
+		arena = slab::Arena::acquire(other.arena);
+		slab::Arena::release(previous);
+		return *this;
+	}
+
+	~SlabAllocator()
+	{
+		slab::Arena::release(arena);
+	}
+
+	T *allocate(std::size_t n)
+	{
+		if(n != 1)
+			return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+		return static_cast<T*>(arena->pool(sizeof(T), alignof(T)).allocate());
+	}
+
+	void deallocate(T *p, std::size_t n)
+	{
+		if(n != 1)
+		{
+			::operator delete(p, std::align_val_t(alignof(T)));
+			return;
+		}
+		arena->pool(sizeof(T), alignof(T)).deallocate(p);
+	}
+
+	// Whether no other copy or rebind shares the arena, so destroying this one releases it.
+	bool isLastCopy() const
+	{
+		return !arena->isShared();
+	}
+
+	SlabAllocator select_on_container_copy_construction() const
+	{
+		return SlabAllocator();
+	}
+
+	template <typename U>
+	bool operator==(const SlabAllocator<U>& other) const
+	{
+		return arena == other.arena;
+	}
+
+	template <typename U>
+	bool operator!=(const SlabAllocator<U>& other) const
+	{
+		return arena != other.arena;
+	}
+
+private:
+	template <typename U>
+	friend class SlabAllocator;
+
+	slab::Arena *arena;
+};
+
+// Allocators that reclaim all their memory at once when the last copy is destroyed. A container whose
+// allocator is the last copy (lastCopy) may skip freeing trivially destructible nodes one by one in its
+// destructor. Containers sharing an arena, like the two halves of a split, still free their nodes, or
+// the arena would keep them until the last container is gone.
+template <typename Allocator>
+struct releasesOnDestruction : std::false_type
+{
+	static bool lastCopy(const Allocator&)
+	{
+		return false;
+	}
+};
+
+template <typename T>
+struct releasesOnDestruction<SlabAllocator<T>> : std::true_type
+{
+	static bool lastCopy(const SlabAllocator<T>& allocator)
+	{
+		return allocator.isLastCopy();
+	}
+};
+
+}
+
+#endif /* AISDI_MAPS_SLABALLOCATOR_H */
@@ -0,0 +1,166 @@
+#ifndef AISDI_MAPS_SNAPSHOT_H
+#define AISDI_MAPS_SNAPSHOT_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Hashing.h"
+
+namespace aisdi
+{
+
+// Binary image of a hash map that MappedHashMap searches in place. After the header come the first
+// entry index of every bucket and one past the last, then the entries grouped by bucket, each a
+// value_type as laid out in memory. All positions are offsets into the file, so the image may be
+// mapped at any address, but only by a program with the same key and value types, hasher and ABI.
+namespace snapshot
+{
+	constexpr char magic[8] = {'A', 'I', 'S', 'D', 'I', 'H', 'M', 'S'};
+	constexpr std::uint32_t version = 1;
+	constexpr std::uint32_t byteOrder = 0x01020304;
+
+	struct Header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byteOrder;
+		std::uint64_t entrySize;
+		std::uint64_t entryAlignment;
+		std::uint64_t size;
+		std::uint64_t bucketCount; // a power of two
+		std::uint64_t bucketsOffset;
+		std::uint64_t entriesOffset;
+	};
+
+	// Buckets of the image do not depend on the bucket policy of the map that wrote it.
+	template <typename Hash>
+	std::uint64_t bucketOf(std::size_t hash, std::uint64_t bucketCount)
+	{
+		if(!hashing::isAvalanching<Hash>::value)
+			hash = hashing::mix(hash);
+		return hash & (bucketCount - 1);
+	}
+
+	inline std::uint64_t bucketCountFor(std::uint64_t size)
+	{
+		std::uint64_t count = 1;
+		while(count < size)
+			count *= 2;
+		return count;
+	}
+
+	inline std::uint64_t alignUp(std::uint64_t offset, std::uint64_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	// Removes the temporary file of a failed save and closes it.
+	inline void discard(int file, const std::string& path)
+	{
+		if(file >= 0)
+			close(file);
+		unlink(path.c_str());
+	}
+
+	// Writes size values, which forEach passes to its callback, to path. Two passes over the values
+	// place them by bucket without sorting, straight into a mapping of the file, so no copy of the
+	// entries is built in memory. The image is written to a temporary file next to path and renamed
+	// over it when complete: a MappedHashMap of the previous image keeps reading that one, and a
+	// failed save leaves it in place.
+	template <typename Value, typename Hash, typename ForEach>
+	void write(const std::string& path, std::uint64_t size, const Hash& hash, ForEach forEach)
+	{
+		static_assert(std::is_trivially_copyable<typename Value::first_type>::value
+				&& std::is_trivially_copyable<typename Value::second_type>::value,
+				"a snapshot needs trivially copyable keys and values");
+		Header header{};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.byteOrder = byteOrder;
+		header.entrySize = sizeof(Value);
+		header.entryAlignment = alignof(Value);
+		header.size = size;
+		header.bucketCount = bucketCountFor(size);
+		header.bucketsOffset = sizeof(Header);
+		header.entriesOffset = alignUp(header.bucketsOffset + (header.bucketCount + 1) * sizeof(std::uint64_t),
+				header.entryAlignment);
+
+		std::vector<std::uint64_t> starts(header.bucketCount + 1, 0);
+		forEach([&](const Value& value) {
+			starts[bucketOf<Hash>(hash(value.first), header.bucketCount) + 1]++;
+		});
+		for(std::uint64_t i = 1; i <= header.bucketCount; i++)
+			starts[i] += starts[i - 1];
+
+		auto temporary = path + ".XXXXXX";
+		int file = mkstemp(&temporary[0]);
+		if(file < 0)
+			throw std::runtime_error("save");
+		auto fileSize = header.entriesOffset + size * sizeof(Value);
+		// a new file reads as zeros, so the padding between and inside the entries is written as zeros
+		if(fchmod(file, 0644) != 0 || ftruncate(file, static_cast<off_t>(fileSize)) != 0)
+		{
+			discard(file, temporary);
+			throw std::runtime_error("save");
+		}
+		auto mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+		if(mapping == MAP_FAILED)
+		{
+			discard(file, temporary);
+			throw std::runtime_error("save");
+		}
+		auto bytes = static_cast<unsigned char*>(mapping);
+		std::memcpy(bytes, &header, sizeof(header));
+		std::memcpy(bytes + header.bucketsOffset, starts.data(), starts.size() * sizeof(std::uint64_t));
+		auto entries = bytes + header.entriesOffset;
+		try
+		{
+			forEach([&](const Value& value) {
+				auto bucket = bucketOf<Hash>(hash(value.first), header.bucketCount);
+				new(entries + starts[bucket]++ * sizeof(Value)) Value(value);
+			});
+		}
+		catch(...)
+		{
+			munmap(mapping, fileSize);
+			discard(file, temporary);
+			throw;
+		}
+		bool written = msync(mapping, fileSize, MS_SYNC) == 0;
+		munmap(mapping, fileSize);
+		if(!written || fsync(file) != 0 || close(file) != 0)
+		{
+			discard(-1, temporary);
+			throw std::runtime_error("save");
+		}
+		if(std::rename(temporary.c_str(), path.c_str()) != 0)
+		{
+			discard(-1, temporary);
+			throw std::runtime_error("save");
+		}
+		// the rename itself is only durable once the directory is
+		auto slash = path.rfind('/');
+		auto directory = slash == std::string::npos ? std::string(".") : path.substr(0, slash + 1);
+		int folder = open(directory.c_str(), O_RDONLY);
+		if(folder >= 0)
+		{
+			fsync(folder);
+			close(folder);
+		}
+	}
+}
+
+}
+
+#endif /* AISDI_MAPS_SNAPSHOT_H */
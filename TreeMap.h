@@ -2,14 +2,92 @@
 #define AISDI_MAPS_TREEMAP_H
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <initializer_list>
 #include <stdexcept>
 #include <utility>
 #include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <tuple>
+#include <vector>
+
+#include "SlabAllocator.h"
+#include "Balancing.h"
+#include "Parallel.h"
 
 namespace aisdi {
 
-	template<typename KeyType, typename ValueType>
+	namespace tree {
+		// Size of the subtree rooted at a node. Empty unless order statistics are enabled, so a plain
+		// node stays as small as it was.
+		template<bool Counted>
+		struct SubtreeSize {
+		};
+
+		template<>
+		struct SubtreeSize<true> {
+			std::size_t count = 1;
+		};
+
+		// A comparator that does not return bool is taken as three-way, with a negative, zero or positive
+		// result like strcmp.
+		template<typename Compare, typename Key>
+		using isThreeWay = std::negation<std::is_same<std::invoke_result_t<const Compare &, const Key &, const Key &>, bool>>;
+
+		template<typename Key, typename = void>
+		struct hasCompare : std::false_type {
+		};
+
+		template<typename Key>
+		struct hasCompare<Key, std::void_t<decltype(std::declval<const Key &>().compare(std::declval<const Key &>()))>>
+				: std::true_type {
+		};
+
+		// A comparator declaring using is_transparent = void; takes any type comparable with the key, so a
+		// std::string_view can be looked up without building a std::string.
+		template<typename Compare, typename = void>
+		struct isTransparent : std::false_type {
+		};
+
+		template<typename Compare>
+		struct isTransparent<Compare, std::void_t<typename Compare::is_transparent>> : std::true_type {
+		};
+
+		inline void prefetch(const void *address) {
+#if defined(__GNUC__)
+			__builtin_prefetch(address);
+#else
+			(void) address;
+#endif
+		}
+	}
+
+	// Three-way comparator for TreeMap, one call of which tells less, equal and greater keys apart.
+	// Keys with a compare member, like std::string, are compared in one pass, others with two <.
+	template<typename Key>
+	struct ThreeWayCompare {
+		int operator()(const Key &a, const Key &b) const {
+			if constexpr (tree::hasCompare<Key>::value) {
+				auto result = a.compare(b);
+				return (result > 0) - (result < 0);
+			} else
+				return (b < a) - (a < b);
+		}
+	};
+
+	// With OrderStatistics every node also counts its subtree, which gives rank, select and count_range
+	// in logarithmic time.
+	// Compare is a less-than comparator like std::less, or a three-way one like ThreeWayCompare. Either
+	// way a descent compares once per level: with less-than the equality test is left for the one node
+	// the descent ends at, a three-way result tells equality right away.
+	// Balance is RedBlackPolicy or AvlPolicy from Balancing.h. AVL keeps the tree lower, which suits maps
+	// read far more often than written.
+	template<typename KeyType, typename ValueType, typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+			bool OrderStatistics = false, typename Compare = std::less<KeyType>, typename Balance = RedBlackPolicy>
 	class TreeMap {
 	public:
 		using key_type = KeyType;
@@ -18,6 +96,8 @@ namespace aisdi {
 		using size_type = std::size_t;
 		using reference = value_type &;
 		using const_reference = const value_type &;
+		using allocator_type = Allocator;
+		using key_compare = Compare;
 
 		class ConstIterator;
 
@@ -25,46 +105,178 @@ namespace aisdi {
 
 		using iterator = Iterator;
 		using const_iterator = ConstIterator;
+
+		// A pair of iterators usable in a range-based for loop.
+		template<typename It>
+		class Range {
+			It first, last;
+		public:
+			Range(It first, It last) : first(first), last(last) {}
+
+			It begin() const {
+				return first;
+			}
+
+			It end() const {
+				return last;
+			}
+
+			bool isEmpty() const {
+				return first == last;
+			}
+		};
 	private:
 
-		class Node {
+		// Links come first, next to the key a descent reads. The tag of the balancing policy is kept in the
+		// two lowest bits of the parent pointer, which the alignment of nodes leaves free.
+		class Node : public tree::SubtreeSize<OrderStatistics> {
+			static constexpr std::uintptr_t tagMask = 3;
+
+			std::uintptr_t parentAndTag = 0;
 		public:
+			Node *left = nullptr, *right = nullptr;
 			value_type value;
-			bool color = 0; // 0 = black, 1 = red
-			Node *parent, *left, *right;
 
-			Node() : parent(nullptr), left(nullptr), right(nullptr) {}
+			Node() {}
 
-			Node(const key_type &key) : value(std::make_pair(key, ValueType())), parent(nullptr), left(nullptr),
-																	right(nullptr) {}
+			template<typename... Args>
+			explicit Node(std::in_place_t, Args &&... args) : value(std::forward<Args>(args)...) {}
+
+			Node(const Node *node) : tree::SubtreeSize<OrderStatistics>(*node), parentAndTag(node->getTag()),
+															 value(node->value) {}
+
+			Node *getParent() const {
+				return reinterpret_cast<Node *>(parentAndTag & ~tagMask);
+			}
 
-			Node(const Node *node) : value(std::make_pair(node->value.first, node->value.second)), color(node->color),
-															 parent(node->parent), left(node->left), right(node->right) {}
+			void setParent(Node *node) {
+				parentAndTag = reinterpret_cast<std::uintptr_t>(node) | (parentAndTag & tagMask);
+			}
+
+			unsigned getTag() const {
+				return static_cast<unsigned>(parentAndTag & tagMask);
+			}
+
+			void setTag(unsigned tag) {
+				parentAndTag = (parentAndTag & ~tagMask) | tag;
+			}
 		};
 
+		friend Balance;
+
+		using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+		using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+		static constexpr bool threeWay = tree::isThreeWay<Compare, KeyType>::value;
+		static constexpr size_type lookupGroup = 8; // descents find_many interleaves
+
+		// Enables the lookups by any key type K when Compare is transparent, like std::less<>.
+		template<typename K>
+		using IfTransparent = std::enable_if_t<tree::isTransparent<Compare>::value, K>;
+
+		NodeAllocator allocator;
+		Compare comparator;
 		size_type size = 0;
-		Node *root = nullptr, *min = nullptr;
+		Node *root = nullptr, *min = nullptr, *max = nullptr;
 		Node sentinel;
 
+		template<typename... Args>
+		Node *createNode(Args &&... args) {
+			auto node = NodeTraits::allocate(allocator, 1);
+			try {
+				NodeTraits::construct(allocator, node, std::forward<Args>(args)...);
+			} catch (...) {
+				NodeTraits::deallocate(allocator, node, 1);
+				throw;
+			}
+			return node;
+		}
+
+		void destroyNode(Node *node) {
+			NodeTraits::destroy(allocator, node);
+			NodeTraits::deallocate(allocator, node, 1);
+		}
+
 		void deleteTree(Node *node) {
 			if (node == nullptr)
 				return;
 			deleteTree(node->left);
 			deleteTree(node->right);
-			delete (node);
+			destroyNode(node);
 		}
 
-		void copyInOrder(Node *node, Node *copyTreeNode) {
-			if (node != nullptr) {
-				if (node->left != nullptr) {
-					copyTreeNode->left = new Node(node->left);
-					copyInOrder(node->left, copyTreeNode->left);
-				}
-				if (node->right != nullptr) {
-					copyTreeNode->right = new Node(node->right);
-					copyInOrder(node->right, copyTreeNode->right);
-				}
+		// Copies the subtree of node into slot. Nodes are linked in as soon as they are created, so a
+		// throwing copy leaves a tree the caller can still delete.
+		void copyTree(const Node *node, Node *parent, Node *&slot) {
+			slot = createNode(node);
+			slot->setParent(parent);
+			if (node->left != nullptr)
+				copyTree(node->left, slot, slot->left);
+			if (node->right != nullptr)
+				copyTree(node->right, slot, slot->right);
+		}
+
+		void copyFrom(const TreeMap &other) {
+			if (other.root == nullptr)
+				return;
+			try {
+				copyTree(other.root, &sentinel, root);
+			} catch (...) {
+				deleteTree(root);
+				root = nullptr;
+				throw;
 			}
+			sentinel.right = root;
+			min = leftmost(root);
+			max = rightmost(root);
+			size = other.size;
+		}
+
+		bool lessKeys(const key_type &a, const key_type &b) const {
+			if constexpr (threeWay)
+				return comparator(a, b) < 0;
+			else
+				return comparator(a, b);
+		}
+
+		// Sign of the comparison of a with b, in two calls of a less-than comparator.
+		int compareKeys(const key_type &a, const key_type &b) const {
+			if constexpr (threeWay) {
+				auto result = comparator(a, b);
+				return (result > 0) - (result < 0);
+			} else
+				return comparator(a, b) ? -1 : comparator(b, a);
+		}
+
+		static size_type countOf(const Node *node) {
+			if constexpr (OrderStatistics)
+				return node == nullptr ? 0 : node->count;
+			else
+				return 0;
+		}
+
+		static void recount(Node *node) {
+			if constexpr (OrderStatistics)
+				node->count = 1 + countOf(node->left) + countOf(node->right);
+		}
+
+		// Adds delta to the counts of node and all its ancestors.
+		void adjustCounts(Node *node, std::ptrdiff_t delta) {
+			if constexpr (OrderStatistics)
+				for (; node != &sentinel; node = node->getParent())
+					node->count += delta;
+		}
+
+		static Node *leftmost(Node *node) {
+			while (node->left != nullptr)
+				node = node->left;
+			return node;
+		}
+
+		static Node *rightmost(Node *node) {
+			while (node->right != nullptr)
+				node = node->right;
+			return node;
 		}
 
 		void rotateLeft(Node *x) {
@@ -73,18 +285,20 @@ namespace aisdi {
 			auto y = x->right;
 			x->right = y->left;
 			if (y->left != nullptr)
-				y->left->parent = x;
-			y->parent = x->parent;
-			if (x->parent == &sentinel) {
+				y->left->setParent(x);
+			y->setParent(x->getParent());
+			if (x->getParent() == &sentinel) {
 				root = y;
 				sentinel.right = root;
-				root->parent = &sentinel;
-			} else if (x == x->parent->left)
-				x->parent->left = y;
+				root->setParent(&sentinel);
+			} else if (x == x->getParent()->left)
+				x->getParent()->left = y;
 			else
-				x->parent->right = y;
+				x->getParent()->right = y;
 			y->left = x;
-			x->parent = y;
+			x->setParent(y);
+			recount(x);
+			recount(y);
 		}
 
 		void rotateRight(Node *x) {
@@ -93,169 +307,657 @@ namespace aisdi {
 			auto y = x->left;
 			x->left = y->right;
 			if (y->right != nullptr)
-				y->right->parent = x;
-			y->parent = x->parent;
-			if (x->parent == &sentinel) {
+				y->right->setParent(x);
+			y->setParent(x->getParent());
+			if (x->getParent() == &sentinel) {
 				root = y;
 				sentinel.right = root;
-				root->parent = &sentinel;
-			} else if (x == x->parent->right)
-				x->parent->right = y;
+				root->setParent(&sentinel);
+			} else if (x == x->getParent()->right)
+				x->getParent()->right = y;
 			else
-				x->parent->left = y;
+				x->getParent()->left = y;
 			y->right = x;
-			x->parent = y;
+			x->setParent(y);
+			recount(x);
+			recount(y);
 		}
 
-		void insertFixup(Node *z) {
-			auto y = z;
-			while (z->parent->color == 1) {
-				if (z->parent == z->parent->parent->left) {
-					y = z->parent->parent->right;
-					if ((y != nullptr) && (y->color == 1)) {
-						z->parent->color = 0;
-						y->color = 0;
-						z->parent->parent->color = 1;
-						z = z->parent->parent;
-					} else {
-						if (z == z->parent->right) {
-							z = z->parent;
-							rotateLeft(z);
-						}
-						z->parent->color = 0;
-						z->parent->parent->color = 1;
-						rotateRight(z->parent->parent);
+		void transplant(Node *u, Node *v) {
+			if (u->getParent() == &sentinel) {
+				root = v;
+				sentinel.right = root;
+			} else if (u == u->getParent()->left)
+				u->getParent()->left = v;
+			else u->getParent()->right = v;
+			if (v != nullptr)
+				v->setParent(u->getParent());
+		}
+
+		// Descends towards key. Returns the node holding it, or nullptr with parent set to the node a new
+		// key would hang from (nullptr when the tree is empty).
+		template<typename K>
+		Node *findNode(const K &key, Node *&parent) const {
+			Node *tmp = root;
+			parent = nullptr;
+			if constexpr (threeWay) {
+				while (tmp != nullptr) {
+					auto order = comparator(key, tmp->value.first);
+					if (order == 0)
+						return tmp;
+					parent = tmp;
+					tmp = order < 0 ? tmp->left : tmp->right;
+				}
+				return nullptr;
+			} else {
+				// the last node not less than key is the only one that can equal it
+				Node *candidate = nullptr;
+				while (tmp != nullptr) {
+					parent = tmp;
+					if (comparator(tmp->value.first, key))
+						tmp = tmp->right;
+					else {
+						candidate = tmp;
+						tmp = tmp->left;
 					}
-				} else {
-					y = z->parent->parent->left;
-					if ((y != nullptr) && (y->color == 1)) {
-						z->parent->color = 0;
-						y->color = 0;
-						z->parent->parent->color = 1;
-						z = z->parent->parent;
-					} else {
-						if (z == z->parent->left) {
-							z = z->parent;
-							rotateRight(z);
+				}
+				if (candidate != nullptr && !comparator(key, candidate->value.first))
+					return candidate;
+				return nullptr;
+			}
+		}
+
+		template<typename K>
+		Node *findKey(const K &key) const {
+			Node *parent;
+			return findNode(key, parent);
+		}
+
+		// One of the descents of a batched lookup. candidate is as in findNode.
+		struct Descent {
+			const key_type *key;
+			Node *node, *candidate;
+		};
+
+		// Takes descent one level down and prefetches the node it reaches.
+		void stepDescent(Descent &descent) const {
+			auto node = descent.node;
+			if constexpr (threeWay) {
+				auto order = comparator(*descent.key, node->value.first);
+				if (order == 0) {
+					descent.candidate = node;
+					descent.node = nullptr;
+					return;
+				}
+				descent.node = order < 0 ? node->left : node->right;
+			} else if (comparator(node->value.first, *descent.key))
+				descent.node = node->right;
+			else {
+				descent.candidate = node;
+				descent.node = node->left;
+			}
+			if (descent.node != nullptr)
+				tree::prefetch(descent.node);
+		}
+
+		// Looks the keys of [first, last) up a group at a time. The descents of a group take turns one
+		// level each, so the cache miss of every level of one overlaps with those of the others.
+		template<typename KeyIt, typename Visit>
+		void findEach(KeyIt first, KeyIt last, Visit visit) const {
+			Descent descents[lookupGroup];
+			while (first != last) {
+				size_type count = 0;
+				for (; first != last && count < lookupGroup; ++first, count++)
+					descents[count] = Descent{&*first, root, nullptr};
+				for (bool active = true; active;) {
+					active = false;
+					for (size_type i = 0; i < count; i++)
+						if (descents[i].node != nullptr) {
+							stepDescent(descents[i]);
+							active = true;
 						}
-						z->parent->color = 0;
-						z->parent->parent->color = 1;
-						rotateLeft(z->parent->parent);
-					}
+				}
+				for (size_type i = 0; i < count; i++) {
+					auto candidate = descents[i].candidate;
+					if (!threeWay && candidate != nullptr && lessKeys(*descents[i].key, candidate->value.first))
+						candidate = nullptr;
+					visit(candidate);
 				}
 			}
-			root->color = 0;
 		}
 
-		void transplant(Node *u, Node *v) {
-			if (u->parent == &sentinel) {
-				root = v;
-				root->parent = &sentinel;
+		// findNode for keys that often come in ascending order: one beyond the largest key is placed
+		// without descending.
+		Node *findSlot(const key_type &key, Node *&parent) const {
+			if (root != nullptr && lessKeys(max->value.first, key)) {
+				parent = max;
+				return nullptr;
+			}
+			return findNode(key, parent);
+		}
+
+		// Like findSlot, and in amortized O(1) as well when key belongs right before or right after hint.
+		Node *findSlotNear(const_iterator hint, const key_type &key, Node *&parent) const {
+			auto next = hint.getCurrent();
+			if (root == nullptr || lessKeys(max->value.first, key))
+				return findSlot(key, parent);
+			if (next != &sentinel && lessKeys(key, next->value.first)) {
+				if (next == min) {
+					parent = min;
+					return nullptr;
+				}
+				// the hint may be older than min, so the step back starts from a fresh iterator
+				auto previous = (--const_iterator(next, this)).getCurrent();
+				if (lessKeys(previous->value.first, key)) {
+					// between two neighbours one of them has a free slot facing the other
+					parent = previous->right == nullptr ? previous : next;
+					return nullptr;
+				}
+			} else if (next != &sentinel && lessKeys(next->value.first, key)) {
+				auto following = (++const_iterator(next, this)).getCurrent();
+				if (lessKeys(key, following->value.first)) {
+					parent = next->right == nullptr ? next : following;
+					return nullptr;
+				}
+			}
+			return findNode(key, parent);
+		}
+
+		iterator attachNode(Node *node, Node *parent) {
+			size++;
+			Balance::initNode(node, 0, 0);
+			if (parent == nullptr) {
+				root = node;
+				root->setParent(&sentinel);
 				sentinel.right = root;
-			} else if (u == u->parent->left)
-				u->parent->left = v;
-			else u->parent->right = v;
-			v->parent = u->parent;
-		}
-
-		void removeFixup(Node *x) {
-			Node * w;
-			while ((x != root) && (x->color == 0)){
-				if (x == x->parent->left){
-					w = x->parent->right;
-					if (w->color == 1){
-						w->color = 0;
-						x->parent->color = 1;
-						rotateLeft(x->parent);
-						w = x->parent->right;
-					}
-					if (w->left->color == 0 && w->right->color == 0) {
-						w->color = 0;
-						x = x->parent;
-					} else {
-						if (w->right->color == 0) {
-							w->left->color = 0;
-							w->color = 1;
-							rotateRight(w);
-							w = x->parent->right;
-						}
-						w->color = x->parent->color;
-						x->parent->color = 0;
-						w->right->color = 0;
-						rotateLeft(x->parent);
-						x = root;
-						root->parent = &sentinel;
-						sentinel.right = root;
-					}
-				} else {
-					w = x->parent->left;
-					if (w->color == 1){
-						w->color = 0;
-						x->parent->color = 1;
-						rotateRight(x->parent);
-						w = x->parent->left;
-					}
-					if (w->right->color == 0 && w->left->color == 0) {
-						w->color = 0;
-						x = x->parent;
-					} else {
-						if (w->left->color == 0) {
-							w->right->color = 0;
-							w->color = 1;
-							rotateLeft(w);
-							w = x->parent->left;
-						}
-						w->color = x->parent->color;
-						x->parent->color = 0;
-						w->left->color = 0;
-						rotateRight(x->parent);
-						x = root;
-						root->parent = &sentinel;
-						sentinel.right = root;
+				min = max = root;
+			} else {
+				if (lessKeys(parent->value.first, node->value.first))
+					parent->right = node;
+				else parent->left = node;
+				node->setParent(parent);
+				if (lessKeys(node->value.first, min->value.first))
+					min = node;
+				else if (lessKeys(max->value.first, node->value.first))
+					max = node;
+				adjustCounts(parent, 1);
+			}
+			Balance::afterInsert(*this, node);
+			return iterator(const_iterator(node, this));
+		}
+
+		// Creates a node for every element of the range and returns them sorted by key, keeping the first
+		// of equal keys as inserting them one by one would. Sorted input is detected and not sorted again.
+		template<typename InputIt>
+		std::vector<Node *> createSorted(InputIt first, InputIt last) {
+			std::vector<Node *> nodes;
+			try {
+				if constexpr (std::is_base_of<std::forward_iterator_tag,
+						typename std::iterator_traits<InputIt>::iterator_category>::value)
+					nodes.reserve(std::distance(first, last));
+				bool sorted = true;
+				for (; first != last; ++first) {
+					nodes.push_back(nullptr);
+					nodes.back() = createNode(std::in_place, *first);
+					if (nodes.size() > 1 && !lessKeys(nodes[nodes.size() - 2]->value.first, nodes.back()->value.first))
+						sorted = false;
+				}
+				if (!sorted) {
+					std::stable_sort(nodes.begin(), nodes.end(), [this](const Node *a, const Node *b) {
+						return lessKeys(a->value.first, b->value.first);
+					});
+					auto out = nodes.begin();
+					for (auto node : nodes) {
+						if (out != nodes.begin() && !lessKeys((*(out - 1))->value.first, node->value.first))
+							destroyNode(node);
+						else
+							*out++ = node;
 					}
+					nodes.erase(out, nodes.end());
+				}
+			} catch (...) {
+				for (auto node : nodes)
+					if (node != nullptr)
+						destroyNode(node);
+				throw;
+			}
+			return nodes;
+		}
+
+		// Links count sorted nodes into a tree of minimal height and sets height to it. Both halves of
+		// every subtree differ in size by at most one, so all levels but the deepest are full, which
+		// both policies can tag in place: red-black colours just the deepest level red.
+		static Node *buildBalanced(Node **nodes, size_type count, Node *parent, size_type depth, size_type deepest,
+															 size_type &height) {
+			if (count == 0) {
+				height = 0;
+				return nullptr;
+			}
+			auto middle = count / 2;
+			auto node = nodes[middle];
+			node->setParent(parent);
+			if constexpr (OrderStatistics)
+				node->count = count;
+			size_type leftHeight, rightHeight;
+			node->left = buildBalanced(nodes, middle, node, depth + 1, deepest, leftHeight);
+			node->right = buildBalanced(nodes + middle + 1, count - middle - 1, node, depth + 1, deepest, rightHeight);
+			Balance::initBuilt(node, depth == deepest, leftHeight, rightHeight);
+			height = 1 + std::max(leftHeight, rightHeight);
+			return node;
+		}
+
+		// Replaces the tree by the sorted, unique nodes in linear time.
+		void buildFrom(std::vector<Node *> &nodes) {
+			size = nodes.size();
+			if (nodes.empty()) {
+				root = nullptr;
+				sentinel.right = nullptr;
+				min = &sentinel;
+				max = &sentinel;
+				return;
+			}
+			size_type deepest = 0;
+			while ((size_type(2) << deepest) <= nodes.size())
+				deepest++;
+			size_type height;
+			root = buildBalanced(nodes.data(), nodes.size(), &sentinel, 0, deepest, height);
+			Balance::normalizeRoot(root, height);
+			sentinel.right = root;
+			min = nodes.front();
+			max = nodes.back();
+		}
+
+		// The first node whose key is not less than key, or the sentinel.
+		Node *lowerBoundNode(const key_type &key) const {
+			Node *tmp = root, *result = &(const_cast<Node &>(sentinel));
+			while (tmp != nullptr) {
+				if (lessKeys(tmp->value.first, key))
+					tmp = tmp->right;
+				else {
+					result = tmp;
+					tmp = tmp->left;
+				}
+			}
+			return result;
+		}
+
+		// The first node whose key is greater than key, or the sentinel.
+		Node *upperBoundNode(const key_type &key) const {
+			Node *tmp = root, *result = &(const_cast<Node &>(sentinel));
+			while (tmp != nullptr) {
+				if (lessKeys(key, tmp->value.first)) {
+					result = tmp;
+					tmp = tmp->left;
+				} else
+					tmp = tmp->right;
+			}
+			return result;
+		}
+
+		Node *selectNode(size_type k) const {
+			static_assert(OrderStatistics, "select needs a TreeMap with order statistics");
+			if (k >= size)
+				throw std::out_of_range("select");
+			auto tmp = root;
+			while (countOf(tmp->left) != k) {
+				if (k < countOf(tmp->left))
+					tmp = tmp->left;
+				else {
+					k -= countOf(tmp->left) + 1;
+					tmp = tmp->right;
 				}
 			}
+			return tmp;
+		}
+
+		// A detached subtree with its rank under the balancing policy, which guides joins.
+		struct Subtree {
+			Node *root;
+			size_type rank;
+		};
+
+		Subtree detach() {
+			Subtree tree{root, Balance::rankOf(root)};
+			root = nullptr;
+			sentinel.right = nullptr;
+			min = &sentinel;
+			max = &sentinel;
+			size = 0;
+			return tree;
+		}
+
+		void attach(Subtree tree, size_type elements) {
+			root = tree.root;
+			size = elements;
+			sentinel.right = root;
+			if (root == nullptr) {
+				min = &sentinel;
+				max = &sentinel;
+				return;
+			}
+			root->setParent(&sentinel);
+			Balance::normalizeRoot(root, tree.rank);
+			min = leftmost(root);
+			max = rightmost(root);
+		}
+
+		// Joins the trees of the keys below and above pivot's key. The pivot is hung from the spine of the
+		// taller tree, where the policy finds a subtree about as high as the other tree, and the policy
+		// repairs the rest as after an insert, so the cost is the difference of the ranks. root and
+		// sentinel serve as scratch, the tree has to be detached.
+		Subtree joinTrees(Subtree left, Node *pivot, Subtree right) {
+			Balance::normalizeRoot(left.root, left.rank);
+			Balance::normalizeRoot(right.root, right.rank);
+			Node *parent = &sentinel, *child;
+			bool leftTaller = left.rank >= right.rank;
+			auto &taller = leftTaller ? left : right;
+			auto &shorter = leftTaller ? right : left;
+			child = taller.root;
+			if (child != nullptr) {
+				root = child;
+				root->setParent(&sentinel);
+			}
+			auto height = taller.rank;
+			while (Balance::descend(child, height, shorter.rank)) {
+				height = Balance::childRank(child, height, !leftTaller);
+				parent = child;
+				child = leftTaller ? child->right : child->left;
+			}
+			if (leftTaller)
+				Balance::initNode(pivot, height, right.rank);
+			else
+				Balance::initNode(pivot, left.rank, height);
+			pivot->left = leftTaller ? child : left.root;
+			pivot->right = leftTaller ? right.root : child;
+			if (pivot->left != nullptr)
+				pivot->left->setParent(pivot);
+			if (pivot->right != nullptr)
+				pivot->right->setParent(pivot);
+			pivot->setParent(parent);
+			if (parent == &sentinel)
+				root = pivot;
+			else if (leftTaller)
+				parent->right = pivot;
+			else
+				parent->left = pivot;
+			sentinel.right = root;
+			recount(pivot);
+			adjustCounts(parent, static_cast<std::ptrdiff_t>(countOf(pivot) - countOf(child)));
+			Subtree joined{nullptr, taller.rank + Balance::afterInsert(*this, pivot)};
+			joined.root = root;
+			root = nullptr;
+			sentinel.right = nullptr;
+			return joined;
+		}
+
+		// Takes the node with the largest key out of a non-empty tree.
+		Subtree splitLast(Subtree tree, Node *&last) {
+			auto node = tree.root;
+			Subtree left{node->left, Balance::childRank(node, tree.rank, true)};
+			if (node->right == nullptr) {
+				last = node;
+				return left;
+			}
+			auto rest = splitLast(Subtree{node->right, Balance::childRank(node, tree.rank, false)}, last);
+			return joinTrees(left, node, rest);
+		}
+
+		// Joins trees whose keys are all below and all above each other.
+		Subtree joinPair(Subtree left, Subtree right) {
+			if (right.root == nullptr)
+				return left;
+			if (left.root == nullptr)
+				return right;
+			Node *last;
+			auto rest = splitLast(left, last);
+			return joinTrees(rest, last, right);
+		}
+
+		// Splits tree into the keys less and greater than key and returns the node holding key, or
+		// nullptr. Joins on the way back up cost O(log n) in total, as their heights telescope.
+		Node *splitAt(Subtree tree, const key_type &key, Subtree &less, Subtree &greater) {
+			auto node = tree.root;
+			if (node == nullptr) {
+				less = greater = Subtree{nullptr, 0};
+				return nullptr;
+			}
+			Subtree left{node->left, Balance::childRank(node, tree.rank, true)};
+			Subtree right{node->right, Balance::childRank(node, tree.rank, false)};
+			auto order = compareKeys(key, node->value.first);
+			if (order == 0) {
+				less = left;
+				greater = right;
+				return node;
+			}
+			Node *found;
+			if (order < 0) {
+				found = splitAt(left, key, less, left);
+				greater = joinTrees(left, node, right);
+			} else {
+				found = splitAt(right, key, right, greater);
+				less = joinTrees(left, node, right);
+			}
+			return found;
+		}
+
+		// Moves the nodes of from into into by splitting into at the root key of from, merging the halves
+		// recursively and joining them again. Nodes whose keys into holds already end up in leftover.
+		Subtree mergeTrees(Subtree into, Subtree from, Subtree &leftover, size_type &duplicates) {
+			if (from.root == nullptr || into.root == nullptr) {
+				leftover = Subtree{nullptr, 0};
+				return into.root == nullptr ? from : into;
+			}
+			auto node = from.root;
+			Subtree fromLeft{node->left, Balance::childRank(node, from.rank, true)};
+			Subtree fromRight{node->right, Balance::childRank(node, from.rank, false)};
+			Subtree less, greater, leftLeftover, rightLeftover;
+			auto found = splitAt(into, node->value.first, less, greater);
+			auto left = mergeTrees(less, fromLeft, leftLeftover, duplicates);
+			auto right = mergeTrees(greater, fromRight, rightLeftover, duplicates);
+			if (found != nullptr) {
+				duplicates++;
+				leftover = joinTrees(leftLeftover, node, rightLeftover);
+				return joinTrees(left, found, right);
+			}
+			leftover = joinPair(leftLeftover, rightLeftover);
+			return joinTrees(left, node, right);
+		}
+
+		// Moves the nodes of a detached subtree into the tree one by one, in key order. Nodes whose keys
+		// are present already are appended to leftover, joined with other as scratch.
+		void moveNodes(Node *node, TreeMap &other, Subtree &leftover, size_type &duplicates) {
+			if (node == nullptr)
+				return;
+			auto right = node->right;
+			moveNodes(node->left, other, leftover, duplicates);
+			node->left = node->right = nullptr;
+			if constexpr (OrderStatistics)
+				node->count = 1;
+			Node *parent;
+			if (findSlot(node->value.first, parent) != nullptr) {
+				duplicates++;
+				leftover = other.joinTrees(leftover, node, Subtree{nullptr, 0});
+			} else
+				attachNode(node, parent);
+			moveNodes(right, other, leftover, duplicates);
+		}
+
+		// Moves the values of other whose keys are absent here into new nodes of this map, for maps
+		// with unequal allocators, whose nodes cannot change owner. The const keys are copied.
+		void moveValues(TreeMap &other) {
+			std::vector<Node *> nodes;
+			nodes.reserve(other.size);
+			for (auto it = other.cbegin(); it != other.cend(); ++it)
+				nodes.push_back(it.getCurrent());
+			for (auto node : nodes)
+				if (tryEmplace(node->value.first, std::move(node->value.second)).second)
+					other.remove(const_iterator(node, &other));
+		}
+
+		// Keeps the nodes of tree whose keys are (keepCommon) or are not in the subtree of other, and
+		// counts the common keys.
+		Subtree filterTrees(Subtree tree, const Node *other, bool keepCommon, size_type &common) {
+			if (tree.root == nullptr || other == nullptr) {
+				if (!keepCommon)
+					return tree;
+				deleteTree(tree.root);
+				return Subtree{nullptr, 0};
+			}
+			Subtree less, greater;
+			auto found = splitAt(tree, other->value.first, less, greater);
+			auto left = filterTrees(less, other->left, keepCommon, common);
+			auto right = filterTrees(greater, other->right, keepCommon, common);
+			if (found == nullptr)
+				return joinPair(left, right);
+			common++;
+			if (keepCommon)
+				return joinTrees(left, found, right);
+			destroyNode(found);
+			return joinPair(left, right);
+		}
+
+		// A piece of a parallel walk: a single node or, when whole, its subtree.
+		struct Piece {
+			Node *node;
+			bool whole;
+		};
+
+		// Cuts the subtree of node into pieces in key order, splitting at subtree roots down to depth
+		// levels, so a balanced tree gives 2^depth subtrees of about the same size.
+		static void cutPieces(Node *node, unsigned depth, std::vector<Piece> &pieces) {
+			if (node == nullptr)
+				return;
+			if (depth == 0) {
+				pieces.push_back(Piece{node, true});
+				return;
+			}
+			cutPieces(node->left, depth - 1, pieces);
+			pieces.push_back(Piece{node, false});
+			cutPieces(node->right, depth - 1, pieces);
+		}
+
+		std::vector<Piece> piecesFor(unsigned threads) const {
+			unsigned depth = 0;
+			while ((size_type(1) << depth) < parallel::chunksFor(threads))
+				depth++;
+			std::vector<Piece> pieces;
+			cutPieces(root, depth, pieces);
+			return pieces;
+		}
+
+		// Calls visit with the values of the subtree of node in key order.
+		template<typename Visit>
+		static void visitSubtree(Node *node, Visit &visit) {
+			for (; node != nullptr; node = node->right) {
+				visitSubtree(node->left, visit);
+				visit(node->value);
+			}
+		}
+
+		template<typename Visit>
+		static void visitPiece(const Piece &piece, Visit &&visit) {
+			if (piece.whole)
+				visitSubtree(piece.node, visit);
+			else
+				visit(piece.node->value);
+		}
+
+		static size_type heightOf(const Node *node) {
+			return node == nullptr ? 0 : 1 + std::max(heightOf(node->left), heightOf(node->right));
+		}
+
+		static size_type heightFor(size_type elements) {
+			size_type height = 0;
+			for (; elements > 0; elements /= 2)
+				height++;
+			return height;
+		}
+
+		template<typename K, typename... Args>
+		std::pair<iterator, bool> tryEmplace(K &&key, Args &&... args) {
+			Node *parent;
+			auto found = findSlot(key, parent);
+			if (found != nullptr)
+				return std::make_pair(iterator(const_iterator(found, this)), false);
+			auto node = createNode(std::in_place, std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+														 std::forward_as_tuple(std::forward<Args>(args)...));
+			return std::make_pair(attachNode(node, parent), true);
+		}
+
+		template<typename K, typename M>
+		std::pair<iterator, bool> insertOrAssign(K &&key, M &&obj) {
+			auto result = tryEmplace(std::forward<K>(key), std::forward<M>(obj));
+			// obj is only consumed when a new node was built from it
+			if (!result.second)
+				result.first->second = std::forward<M>(obj);
+			return result;
 		}
 
 	public:
 		TreeMap() {
 			min = &sentinel;
+			max = &sentinel;
+		}
+
+		explicit TreeMap(const Allocator &allocator) : allocator(allocator) {
+			min = &sentinel;
+			max = &sentinel;
+		}
+
+		explicit TreeMap(const Compare &comparator, const Allocator &allocator = Allocator())
+				: allocator(allocator), comparator(comparator) {
+			min = &sentinel;
+			max = &sentinel;
 		}
 
 		~TreeMap() {
-			deleteTree(root);
+			// an arena allocator held by this tree alone frees its slabs as a whole, so nodes that need no
+			// destructor are not walked
+			if (!(std::is_trivially_destructible<Node>::value && releasesOnDestruction<NodeAllocator>::lastCopy(allocator)))
+				deleteTree(root);
 		}
 
 		TreeMap(std::initializer_list<value_type> list) {
 			min = &sentinel;
+			max = &sentinel;
 			for (auto &&it : list) {
 				(*this)[it.first] = it.second;
 			}
 		}
 
-		TreeMap(const TreeMap &other) {
+		// Builds the tree bottom-up in linear time when the range is sorted by key, and sorts it first
+		// otherwise. Of equal keys the first one is kept.
+		template<typename InputIt>
+		TreeMap(InputIt first, InputIt last) {
 			min = &sentinel;
-			if (other.root != nullptr) {
-				root = new Node(other.root);
-				copyInOrder(root, other.root);
-				sentinel.right = root;
-				root->parent = &sentinel;
-				size = other.size;
-				min = other.min;
-			}
+			max = &sentinel;
+			auto nodes = createSorted(first, last);
+			buildFrom(nodes);
+		}
+
+		TreeMap(const TreeMap &other)
+				: allocator(NodeTraits::select_on_container_copy_construction(other.allocator)),
+					comparator(other.comparator) {
+			min = &sentinel;
+			max = &sentinel;
+			copyFrom(other);
 		}
 
-		TreeMap(TreeMap &&other) {
+		TreeMap(TreeMap &&other) : allocator(other.allocator), comparator(other.comparator) {
+			min = &sentinel;
+			max = &sentinel;
 			if (!other.isEmpty()) {
 				root = other.root;
 				min = other.min;
+				max = other.max;
 				size = other.size;
 				sentinel.right = root;
-				root->parent = &sentinel;
+				root->setParent(&sentinel);
 				other.root = nullptr;
+				other.min = &other.sentinel;
+				other.max = &other.sentinel;
+				other.sentinel.right = nullptr;
 				other.size = 0;
-			} else {
-				min = &sentinel;
 			}
 		}
 
@@ -263,121 +965,298 @@ namespace aisdi {
 			if (*this != other) {
 				deleteTree(root);
 				root = nullptr;
+				sentinel.right = nullptr;
 				min = &sentinel;
-				if (other.root != nullptr) {
-					root = new Node(other.root);
-					copyInOrder(root, other.root);
-					sentinel.right = root;
-					root->parent = &sentinel;
-					min = other.min;
-				}
-				size = other.size;
+				max = &sentinel;
+				size = 0;
+				comparator = other.comparator;
+				copyFrom(other);
 			}
 			return *this;
 		}
 
 		TreeMap &operator=(TreeMap &&other) {
+			if (this == &other)
+				return *this;
 			deleteTree(root);
+			allocator = other.allocator;
+			comparator = other.comparator;
 			if (!other.isEmpty()) {
 				root = other.root;
 				min = other.min;
+				max = other.max;
 				size = other.size;
 				sentinel.right = root;
-				root->parent = &sentinel;
+				root->setParent(&sentinel);
 				other.root = nullptr;
+				other.min = &other.sentinel;
+				other.max = &other.sentinel;
+				other.sentinel.right = nullptr;
 				other.size = 0;
 			} else {
 				size = 0;
 				root = nullptr;
+				sentinel.right = nullptr;
 				min = &sentinel;
+				max = &sentinel;
 			}
 			return *this;
 		}
 
+		allocator_type get_allocator() const {
+			return allocator_type(allocator);
+		}
+
+		key_compare key_comp() const {
+			return comparator;
+		}
+
 		bool isEmpty() const {
 			return size == 0;
 		}
 
 		mapped_type &operator[](const key_type &key) {
-			if (root == nullptr) {
-				size++;
-				root = new Node(key);
-				root->parent = &sentinel;
-				sentinel.right = root;
-				min = root;
-				insertFixup(root);
-				return root->value.second;
+			return tryEmplace(key).first->second;
+		}
+
+		mapped_type &operator[](key_type &&key) {
+			return tryEmplace(std::move(key)).first->second;
+		}
+
+		// The node is built first since the key is only known afterwards; it is freed again when the key
+		// is already present.
+		template<typename... Args>
+		std::pair<iterator, bool> emplace(Args &&... args) {
+			auto node = createNode(std::in_place, std::forward<Args>(args)...);
+			Node *parent;
+			auto found = findSlot(node->value.first, parent);
+			if (found != nullptr) {
+				destroyNode(node);
+				return std::make_pair(iterator(const_iterator(found, this)), false);
 			}
-			auto tmp = root;
-			auto parent = root;
-			while (tmp != nullptr) {
-				parent = tmp;
-				if (tmp->value.first == key)
-					return tmp->value.second;
-				if (key < tmp->value.first)
-					tmp = tmp->left;
-				else
-					tmp = tmp->right;
+			return std::make_pair(attachNode(node, parent), true);
+		}
+
+		// Inserts the value unless its key is present, and returns the element with the key either way.
+		// A hint next to where the key belongs, on either side, saves the descent from the root, so does
+		// any hint for a key above all others.
+		iterator insert(const_iterator hint, const value_type &value) {
+			return emplace_hint(hint, value);
+		}
+
+		iterator insert(const_iterator hint, value_type &&value) {
+			return emplace_hint(hint, std::move(value));
+		}
+
+		template<typename... Args>
+		iterator emplace_hint(const_iterator hint, Args &&... args) {
+			auto node = createNode(std::in_place, std::forward<Args>(args)...);
+			Node *parent;
+			auto found = findSlotNear(hint, node->value.first, parent);
+			if (found != nullptr) {
+				destroyNode(node);
+				return iterator(const_iterator(found, this));
 			}
-			tmp = new Node(key);
-			tmp->color = 1;
-			if (key > parent->value.first)
-				parent->right = tmp;
-			else parent->left = tmp;
-			tmp->parent = parent;
-			if (key < min->value.first)
-				min = tmp;
-			size++;
-			insertFixup(tmp);
-			return tmp->value.second;
+			return attachNode(node, parent);
 		}
 
-		const mapped_type &valueOf(const key_type &key) const {
-			auto tmp = root;
-			while (tmp != nullptr) {
-				if (tmp->value.first == key)
-					return tmp->value.second;
-				if (tmp->value.first < key)
-					tmp = tmp->right;
-				else tmp = tmp->left;
+		// Constructs the value from args only when key is absent; otherwise args are left untouched.
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(const key_type &key, Args &&... args) {
+			return tryEmplace(key, std::forward<Args>(args)...);
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(key_type &&key, Args &&... args) {
+			return tryEmplace(std::move(key), std::forward<Args>(args)...);
+		}
+
+		template<typename M>
+		std::pair<iterator, bool> insert_or_assign(const key_type &key, M &&obj) {
+			return insertOrAssign(key, std::forward<M>(obj));
+		}
+
+		template<typename M>
+		std::pair<iterator, bool> insert_or_assign(key_type &&key, M &&obj) {
+			return insertOrAssign(std::move(key), std::forward<M>(obj));
+		}
+
+		// Inserts the elements whose keys are not in the map yet. A small range is inserted one element
+		// at a time, a large one is merged with the tree and the result rebuilt in linear time.
+		template<typename InputIt>
+		void insert(InputIt first, InputIt last) {
+			auto nodes = createSorted(first, last);
+			if (nodes.size() * heightFor(size) < size) {
+				for (auto node : nodes) {
+					Node *parent;
+					if (findSlot(node->value.first, parent) != nullptr)
+						destroyNode(node);
+					else
+						attachNode(node, parent);
+				}
+				return;
+			}
+			std::vector<Node *> merged;
+			try {
+				merged.reserve(size + nodes.size());
+			} catch (...) {
+				for (auto node : nodes)
+					destroyNode(node);
+				throw;
+			}
+			auto next = nodes.begin();
+			for (auto it = begin(); it != end(); ++it) {
+				auto node = it.getCurrent();
+				while (next != nodes.end() && lessKeys((*next)->value.first, node->value.first))
+					merged.push_back(*next++);
+				if (next != nodes.end() && !lessKeys(node->value.first, (*next)->value.first))
+					destroyNode(*next++);
+				merged.push_back(node);
 			}
-			throw std::out_of_range("valueof");
+			merged.insert(merged.end(), next, nodes.end());
+			buildFrom(merged);
+		}
+
+		const mapped_type &valueOf(const key_type &key) const {
+			auto node = findKey(key);
+			if (node == nullptr)
+				throw std::out_of_range("valueof");
+			return node->value.second;
 		}
 
 		mapped_type &valueOf(const key_type &key) {
-			auto tmp = root;
-			while (tmp != nullptr) {
-				if (tmp->value.first == key)
-					return tmp->value.second;
-				if (tmp->value.first < key)
-					tmp = tmp->right;
-				else tmp = tmp->left;
-			}
-			throw std::out_of_range("valueof");
+			auto node = findKey(key);
+			if (node == nullptr)
+				throw std::out_of_range("valueof");
+			return node->value.second;
 		}
 
 		const_iterator find(const key_type &key) const {
-			auto tmp = root;
-			while (tmp != nullptr) {
-				if (tmp->value.first == key)
-					return const_iterator(tmp, min);
-				if (tmp->value.first < key)
-					tmp = tmp->right;
-				else tmp = tmp->left;
-			}
-			return const_iterator(&(const_cast<Node &>(sentinel)), min);
+			auto node = findKey(key);
+			return const_iterator(node != nullptr ? node : &(const_cast<Node &>(sentinel)), this);
 		}
 
 		iterator find(const key_type &key) {
-			auto tmp = root;
-			while (tmp != nullptr) {
-				if (tmp->value.first == key)
-					return iterator(const_iterator(tmp, min));
-				if (tmp->value.first < key)
-					tmp = tmp->right;
-				else tmp = tmp->left;
-			}
-			return iterator(const_iterator(&sentinel, min));
+			auto node = findKey(key);
+			return iterator(const_iterator(node != nullptr ? node : &sentinel, this));
+		}
+
+		bool contains(const key_type &key) const {
+			return findKey(key) != nullptr;
+		}
+
+		// The value of key, or nullptr when it is missing. Unlike valueOf a miss throws nothing.
+		const mapped_type *get_if(const key_type &key) const {
+			auto node = findKey(key);
+			return node != nullptr ? &node->value.second : nullptr;
+		}
+
+		mapped_type *get_if(const key_type &key) {
+			auto node = findKey(key);
+			return node != nullptr ? &node->value.second : nullptr;
+		}
+
+		// Lookups by any key type the transparent comparator accepts, without converting it to key_type.
+		template<typename K, typename = IfTransparent<K>>
+		const_iterator find(const K &key) const {
+			auto node = findKey(key);
+			return const_iterator(node != nullptr ? node : &(const_cast<Node &>(sentinel)), this);
+		}
+
+		template<typename K, typename = IfTransparent<K>>
+		iterator find(const K &key) {
+			auto node = findKey(key);
+			return iterator(const_iterator(node != nullptr ? node : &sentinel, this));
+		}
+
+		template<typename K, typename = IfTransparent<K>>
+		bool contains(const K &key) const {
+			return findKey(key) != nullptr;
+		}
+
+		template<typename K, typename = IfTransparent<K>>
+		const mapped_type *get_if(const K &key) const {
+			auto node = findKey(key);
+			return node != nullptr ? &node->value.second : nullptr;
+		}
+
+		template<typename K, typename = IfTransparent<K>>
+		mapped_type *get_if(const K &key) {
+			auto node = findKey(key);
+			return node != nullptr ? &node->value.second : nullptr;
+		}
+
+		// Writes an iterator to out for every key of the forward range [first, last), end() for a missing
+		// one. Far faster than a find per key when the tree does not fit in the cache.
+		template<typename KeyIt, typename OutIt>
+		OutIt find_many(KeyIt first, KeyIt last, OutIt out) const {
+			findEach(first, last, [&](Node *node) {
+				*out++ = node != nullptr ? const_iterator(node, this) : cend();
+			});
+			return out;
+		}
+
+		template<typename KeyIt, typename OutIt>
+		OutIt find_many(KeyIt first, KeyIt last, OutIt out) {
+			findEach(first, last, [&](Node *node) {
+				*out++ = iterator(const_iterator(node != nullptr ? node : &sentinel, this));
+			});
+			return out;
+		}
+
+		// Writes to out whether each key of [first, last) is in the map.
+		template<typename KeyIt, typename OutIt>
+		OutIt contains_many(KeyIt first, KeyIt last, OutIt out) const {
+			findEach(first, last, [&](Node *node) {
+				*out++ = node != nullptr;
+			});
+			return out;
+		}
+
+		// Calls function with every entry on up to threads threads, each walking a subtree at a time, in
+		// no particular order. Calls may run concurrently, so function must be safe for that.
+		template<typename Function>
+		void parallel_for_each(Function function, unsigned threads = parallel::defaultThreads()) const {
+			threads = parallel::threadsFor(size, threads);
+			auto pieces = piecesFor(threads);
+			parallel::forEachChunk(pieces.size(), threads, [&](size_type piece) {
+				visitPiece(pieces[piece], [&](const value_type &value) { function(value); });
+			});
+		}
+
+		// As above, with the mapped values open to change.
+		template<typename Function>
+		void parallel_for_each(Function function, unsigned threads = parallel::defaultThreads()) {
+			threads = parallel::threadsFor(size, threads);
+			auto pieces = piecesFor(threads);
+			parallel::forEachChunk(pieces.size(), threads, [&](size_type piece) {
+				visitPiece(pieces[piece], [&](value_type &value) { function(value); });
+			});
+		}
+
+		// Folds the entries of every subtree piece into a copy of identity with accumulate(T, entry) in
+		// key order, then the pieces together with combine(T, T), also in key order. combine has to be
+		// associative with identity as its neutral element, but need not be commutative: the result is
+		// the one a sequential fold in key order gives.
+		template<typename T, typename Accumulate, typename Combine>
+		T parallel_reduce(T identity, Accumulate accumulate, Combine combine,
+											unsigned threads = parallel::defaultThreads()) const {
+			threads = parallel::threadsFor(size, threads);
+			auto pieces = piecesFor(threads);
+			// wrapped, so that a vector of bools does not pack the results of several threads into one word
+			struct Partial {
+				T value;
+			};
+			std::vector<Partial> partial(pieces.size(), Partial{identity});
+			parallel::forEachChunk(pieces.size(), threads, [&](size_type piece) {
+				auto result = identity;
+				visitPiece(pieces[piece], [&](const value_type &value) { result = accumulate(std::move(result), value); });
+				partial[piece].value = std::move(result);
+			});
+			auto result = std::move(identity);
+			for (auto &&slot : partial)
+				result = combine(std::move(result), std::move(slot.value));
+			return result;
 		}
 
 		void remove(const key_type &key) {
@@ -385,48 +1264,267 @@ namespace aisdi {
 		}
 
 		void remove(const const_iterator &it) {
-			Node* x;
-			Node* z = it.getCurrent();
-			if(z == &sentinel) throw std::out_of_range("remove sentinel");
+			Node *x, *xParent;
+			Node *z = it.getCurrent();
+			if (z == nullptr || z == &sentinel) throw std::out_of_range("remove sentinel");
+			if (z == min)
+				min = z->right != nullptr ? leftmost(z->right) : z->getParent();
+			if (z == max)
+				max = z->left != nullptr ? rightmost(z->left) : z->getParent();
 			auto y = z;
-			bool yOriginalColor = y->color;
+			auto removedTag = y->getTag();
+			bool fromLeft; // the side of xParent that lost a node
 			if (z->left == nullptr) {
 				x = z->right;
-				if(z->right != nullptr)
-					transplant(z, z->right);
+				xParent = z->getParent();
+				fromLeft = z == xParent->left;
+				adjustCounts(xParent, -1);
+				transplant(z, z->right);
 			} else if (z->right == nullptr) {
 				x = z->left;
-				if(z->left != nullptr)
-					transplant(z, z->left);
+				xParent = z->getParent();
+				fromLeft = z == xParent->left;
+				adjustCounts(xParent, -1);
+				transplant(z, z->left);
 			} else {
-				auto tmp = z->right;
-				while (tmp->left != nullptr) {
-					tmp = tmp->left;
-				}
-				y = tmp;
-				yOriginalColor = y->color;
+				y = leftmost(z->right);
+				removedTag = y->getTag();
+				adjustCounts(y->getParent(), -1);
 				x = y->right;
-				if (y->parent == z)
-					x->parent = y;
+				fromLeft = y->getParent() != z;
+				if (y->getParent() == z)
+					xParent = y;
 				else {
+					xParent = y->getParent();
 					transplant(y, y->right);
 					y->right = z->right;
-					y->right->parent = y;
+					y->right->setParent(y);
 				}
-				transplant(z , y);
+				transplant(z, y);
 				y->left = z->left;
-				y->left->parent = y;
-				y->color = z->color;
+				y->left->setParent(y);
+				y->setTag(z->getTag());
+				recount(y);
 			}
-			if (yOriginalColor == 0 && x != nullptr)
-				removeFixup(x);
+			Balance::afterRemove(*this, x, xParent, fromLeft, removedTag);
+			destroyNode(z);
 			size--;
 		}
 
+		// Removes [first, last) and returns last. A short range is removed node by node, a long one is
+		// split off the tree at its ends, deleted, and the two sides joined again, in O(k + log n) for
+		// k removed elements.
+		iterator erase(const_iterator first, const_iterator last) {
+			if (first == last)
+				return iterator(last);
+			size_type count = 0;
+			for (auto it = first; it != last; ++it)
+				count++;
+			if (count * heightFor(size) < size) {
+				while (first != last) {
+					auto next = first;
+					++next;
+					remove(first);
+					first = next;
+				}
+				return iterator(const_iterator(last.getCurrent(), this));
+			}
+			auto elements = size;
+			bool toEnd = last == cend();
+			Subtree less, middle, greater;
+			auto lo = splitAt(detach(), first->first, less, middle);
+			if (!toEnd) {
+				auto hi = splitAt(middle, last->first, middle, greater);
+				hi->left = hi->right = nullptr;
+				greater = joinTrees(Subtree{nullptr, 0}, hi, greater);
+			} else
+				greater = Subtree{nullptr, 0};
+			destroyNode(lo);
+			deleteTree(middle.root);
+			attach(joinPair(less, greater), elements - count);
+			return iterator(const_iterator(last.getCurrent(), this));
+		}
+
+		const_iterator lower_bound(const key_type &key) const {
+			return const_iterator(lowerBoundNode(key), this);
+		}
+
+		iterator lower_bound(const key_type &key) {
+			return iterator(const_iterator(lowerBoundNode(key), this));
+		}
+
+		const_iterator upper_bound(const key_type &key) const {
+			return const_iterator(upperBoundNode(key), this);
+		}
+
+		iterator upper_bound(const key_type &key) {
+			return iterator(const_iterator(upperBoundNode(key), this));
+		}
+
+		std::pair<const_iterator, const_iterator> equal_range(const key_type &key) const {
+			return std::make_pair(lower_bound(key), upper_bound(key));
+		}
+
+		std::pair<iterator, iterator> equal_range(const key_type &key) {
+			return std::make_pair(lower_bound(key), upper_bound(key));
+		}
+
+		// The entries with keys in [lo, hi), found by two descents and then walked one successor at a time.
+		Range<const_iterator> range(const key_type &lo, const key_type &hi) const {
+			auto first = lower_bound(lo);
+			return Range<const_iterator>(first, lessKeys(lo, hi) ? lower_bound(hi) : first);
+		}
+
+		Range<iterator> range(const key_type &lo, const key_type &hi) {
+			auto first = lower_bound(lo);
+			return Range<iterator>(first, lessKeys(lo, hi) ? lower_bound(hi) : first);
+		}
+
+		// Moves the elements of other whose keys are absent here into this map, the others stay in other.
+		// Subtrees are split and joined instead of elements inserted one by one, which costs
+		// O(m log(n/m + 1)) for sizes m <= n, and a few elements are moved one node at a time. No element
+		// is copied. Nodes only change owner between maps with equal allocators; otherwise the values
+		// are moved into new nodes one at a time.
+		void merge(TreeMap &other) {
+			if (&other == this || other.isEmpty())
+				return;
+			if (!(allocator == other.allocator)) {
+				moveValues(other);
+				return;
+			}
+			Subtree leftover{nullptr, 0};
+			size_type duplicates = 0;
+			if (other.size * heightFor(size) < size) {
+				// a few elements are cheaper to move into place one at a time
+				auto from = other.detach();
+				moveNodes(from.root, other, leftover, duplicates);
+				other.attach(leftover, duplicates);
+				return;
+			}
+			auto elements = size + other.size;
+			auto into = detach(), from = other.detach();
+			auto merged = mergeTrees(into, from, leftover, duplicates);
+			attach(merged, elements - duplicates);
+			other.attach(leftover, duplicates);
+		}
+
+		// The union of both maps, the values of this map win.
+		void merge(TreeMap &&other) {
+			merge(other);
+			TreeMap duplicates(std::move(other));
+		}
+
+		// Keeps only the keys that other holds as well.
+		void intersect(const TreeMap &other) {
+			if (&other == this)
+				return;
+			size_type common = 0;
+			auto tree = filterTrees(detach(), other.root, true, common);
+			attach(tree, common);
+		}
+
+		// Removes the keys that other holds.
+		void subtract(const TreeMap &other) {
+			if (&other == this) {
+				TreeMap removed(std::move(*this));
+				return;
+			}
+			auto elements = size;
+			size_type common = 0;
+			auto tree = filterTrees(detach(), other.root, false, common);
+			attach(tree, elements - common);
+		}
+
+		// Moves the keys not less than key to the returned map. Splitting takes O(log n), counting the
+		// elements that moved takes as long as iterating over the smaller map, unless the map has order
+		// statistics.
+		TreeMap split(const key_type &key) {
+			TreeMap greater(comparator, get_allocator());
+			if (isEmpty())
+				return greater;
+			auto elements = size;
+			Subtree less, more;
+			auto found = splitAt(detach(), key, less, more);
+			if (found != nullptr) {
+				found->left = found->right = nullptr;
+				more = joinTrees(Subtree{nullptr, 0}, found, more);
+			}
+			attach(less, 0);
+			greater.attach(more, 0);
+			size_type moved;
+			if constexpr (OrderStatistics)
+				moved = countOf(greater.root);
+			else {
+				// without subtree sizes the smaller part is counted, walking both in step
+				auto it = cbegin(), other = greater.cbegin();
+				size_type steps = 0;
+				for (; it != cend() && other != greater.cend(); ++it, ++other)
+					steps++;
+				moved = other == greater.cend() ? steps : elements - steps;
+			}
+			size = elements - moved;
+			greater.size = moved;
+			return greater;
+		}
+
+		// Appends other, whose keys all have to lie above or all below the keys of this map, in
+		// O(log n) time, or element by element when the allocators of the maps differ.
+		void join(TreeMap &&other) {
+			if (other.isEmpty())
+				return;
+			if (isEmpty()) {
+				*this = std::move(other);
+				return;
+			}
+			bool before = lessKeys(max->value.first, other.min->value.first);
+			if (!before && !lessKeys(other.max->value.first, min->value.first))
+				throw std::out_of_range("join");
+			if (!(allocator == other.allocator)) {
+				moveValues(other);
+				return;
+			}
+			auto elements = size + other.size;
+			auto tree = detach(), otherTree = other.detach();
+			attach(before ? joinPair(tree, otherTree) : joinPair(otherTree, tree), elements);
+		}
+
+		// Number of keys less than key.
+		size_type rank(const key_type &key) const {
+			static_assert(OrderStatistics, "rank needs a TreeMap with order statistics");
+			size_type result = 0;
+			for (auto tmp = root; tmp != nullptr;) {
+				if (lessKeys(tmp->value.first, key)) {
+					result += countOf(tmp->left) + 1;
+					tmp = tmp->right;
+				} else
+					tmp = tmp->left;
+			}
+			return result;
+		}
+
+		// The element with index k in key order, counting from 0.
+		const_iterator select(size_type k) const {
+			return const_iterator(selectNode(k), this);
+		}
+
+		iterator select(size_type k) {
+			return iterator(const_iterator(selectNode(k), this));
+		}
+
+		// Number of keys in [lo, hi).
+		size_type count_range(const key_type &lo, const key_type &hi) const {
+			return lessKeys(lo, hi) ? rank(hi) - rank(lo) : 0;
+		}
+
 		size_type getSize() const {
 			return size;
 		}
 
+		// Number of levels, in linear time.
+		size_type getHeight() const {
+			return heightOf(root);
+		}
+
 		bool operator==(const TreeMap &other) const {
 			if (size != other.size) return false;
 			auto it = this->begin();
@@ -443,19 +1541,19 @@ namespace aisdi {
 		}
 
 		iterator begin() {
-			return iterator(const_iterator(min, min));
+			return iterator(const_iterator(min, this));
 		}
 
 		iterator end() {
-			return iterator(const_iterator(&sentinel, min));
+			return iterator(const_iterator(&sentinel, this));
 		}
 
 		const_iterator cbegin() const {
-			return const_iterator(min, min);
+			return const_iterator(min, this);
 		}
 
 		const_iterator cend() const {
-			return const_iterator(&(const_cast<Node &>(sentinel)), min);
+			return const_iterator(&(const_cast<Node &>(sentinel)), this);
 		}
 
 		const_iterator begin() const {
@@ -467,8 +1565,9 @@ namespace aisdi {
 		}
 	};
 
-	template<typename KeyType, typename ValueType>
-	class TreeMap<KeyType, ValueType>::ConstIterator {
+	template<typename KeyType, typename ValueType, typename Allocator, bool OrderStatistics, typename Compare,
+			typename Balance>
+	class TreeMap<KeyType, ValueType, Allocator, OrderStatistics, Compare, Balance>::ConstIterator {
 	public:
 		using reference = typename TreeMap::const_reference;
 		using iterator_category = std::bidirectional_iterator_tag;
@@ -476,7 +1575,8 @@ namespace aisdi {
 		using pointer = const typename TreeMap::value_type *;
 
 	private:
-		Node *current, *min;
+		Node *current;
+		const TreeMap *tree;
 
 		Node *successor(Node *node) {
 			if (node->right != nullptr) {
@@ -486,10 +1586,10 @@ namespace aisdi {
 				}
 				return node;
 			}
-			Node *tmp = node->parent;
-			while (tmp->parent != nullptr && node == tmp->right) {
+			Node *tmp = node->getParent();
+			while (tmp->getParent() != nullptr && node == tmp->right) {
 				node = tmp;
-				tmp = tmp->parent;
+				tmp = tmp->getParent();
 			}
 			return tmp;
 		}
@@ -497,15 +1597,15 @@ namespace aisdi {
 		Node *predecessor(Node *node) {
 			if (node->left != nullptr) {
 				node = node->left;
-				while (node->left != nullptr) {
+				while (node->right != nullptr) {
 					node = node->right;
 				}
 				return node;
 			}
-			Node *tmp = node->parent;
-			while (tmp->parent != nullptr && node == tmp->left) {
+			Node *tmp = node->getParent();
+			while (tmp->getParent() != nullptr && node == tmp->left) {
 				node = tmp;
-				tmp = tmp->parent;
+				tmp = tmp->getParent();
 			}
 			return tmp;
 		}
@@ -513,12 +1613,14 @@ namespace aisdi {
 	public:
 		explicit ConstIterator() {}
 
-		ConstIterator(Node *current, Node *min) : current(current), min(min) {}
+		ConstIterator(Node *current, const TreeMap *tree) : current(current), tree(tree) {}
+
+		ConstIterator(const ConstIterator &other) : current(other.current), tree(other.tree) {}
 
-		ConstIterator(const ConstIterator &other) : current(other.current), min(other.min) {}
+		ConstIterator &operator=(const ConstIterator &other) = default;
 
 		ConstIterator &operator++() {
-			if ((current == nullptr) || (current->parent == nullptr))
+			if ((current == nullptr) || (current->getParent() == nullptr))
 				throw std::out_of_range("++op");
 			current = successor(current);
 			return *this;
@@ -531,23 +1633,23 @@ namespace aisdi {
 		}
 
 		ConstIterator &operator--() {
-			if ((current == nullptr) || (current == min)) throw std::out_of_range("op--");
-			if (current->parent == nullptr) {
-				while (current->right != nullptr)
-					current = current->right;
-			} else
+			if ((current == nullptr) || (current == tree->min)) throw std::out_of_range("op--");
+			// the tree keeps its largest node, so stepping back from the end takes O(1)
+			if (current->getParent() == nullptr)
+				current = tree->max;
+			else
 				current = predecessor(current);
 			return *this;
 		}
 
 		ConstIterator operator--(int) {
 			auto tmp = *this;
-			++(*this);
+			--(*this);
 			return tmp;
 		}
 
 		reference operator*() const {
-			if ((current == nullptr) || (current->parent == nullptr))
+			if ((current == nullptr) || (current->getParent() == nullptr))
 				throw std::out_of_range("op*");
 			return (this->current->value);
 		}
@@ -570,8 +1672,10 @@ namespace aisdi {
 		}
 	};
 
-	template<typename KeyType, typename ValueType>
-	class TreeMap<KeyType, ValueType>::Iterator : public TreeMap<KeyType, ValueType>::ConstIterator {
+	template<typename KeyType, typename ValueType, typename Allocator, bool OrderStatistics, typename Compare,
+			typename Balance>
+	class TreeMap<KeyType, ValueType, Allocator, OrderStatistics, Compare, Balance>::Iterator
+			: public TreeMap<KeyType, ValueType, Allocator, OrderStatistics, Compare, Balance>::ConstIterator {
 	public:
 		using reference = typename TreeMap::reference;
 		using pointer = typename TreeMap::value_type *;
@@ -613,6 +1717,10 @@ namespace aisdi {
 		}
 	};
 
+	template<typename KeyType, typename ValueType, typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>,
+			typename Compare = std::less<KeyType>, typename Balance = RedBlackPolicy>
+	using OrderStatisticTreeMap = TreeMap<KeyType, ValueType, Allocator, true, Compare, Balance>;
+
 }
 
 #endif /* AISDI_MAPS_MAP_H */
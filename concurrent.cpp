@@ -0,0 +1,185 @@
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+#include "HashMap.h"
+#include "ConcurrentHashMap.h"
+#include "RcuHashMap.h"
+
+// Stress test and read scaling benchmark of the maps shared between threads.
+// Build with: g++ -std=c++17 -O2 -pthread concurrent.cpp
+
+using namespace aisdi;
+
+// What a map behind one global mutex looks like, the baseline the other maps replace.
+class LockedHashMap {
+	HashMap<int, std::string> map;
+	mutable std::mutex lock;
+public:
+	bool find(int key) const {
+		std::lock_guard<std::mutex> guard(lock);
+		return map.find(key) != map.end();
+	}
+	void insert_or_assign(int key, const std::string& value) {
+		std::lock_guard<std::mutex> guard(lock);
+		map.insert_or_assign(key, value);
+	}
+	void erase(int key) {
+		std::lock_guard<std::mutex> guard(lock);
+		map.erase(key);
+	}
+};
+
+using IntConcurrentHashMap = ConcurrentHashMap<int, std::string>;
+using IntPow2ConcurrentHashMap = ConcurrentHashMap<int, std::string, std::hash<int>, std::equal_to<int>,
+		std::allocator<std::pair<const int, std::string>>, PowerOfTwoPolicy>;
+using IntRcuHashMap = RcuHashMap<int, std::string>;
+
+bool lookUp(const LockedHashMap &map, int key) {
+	return map.find(key);
+}
+template <typename Map>
+bool lookUp(const Map &map, int key) {
+	return map.contains(key);
+}
+
+std::string valueFor(int key, int version) {
+	return std::to_string(key) + ":" + std::to_string(version);
+}
+bool isValueOf(const std::string &value, int key) {
+	auto prefix = std::to_string(key) + ":";
+	return value.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Writers keep replacing and erasing keys while readers check that whatever value they see belongs
+// to its key, which fails on a torn or freed entry.
+template <typename Map>
+bool stress(size_t threads, size_t keys, size_t operations, std::string mapName) {
+	Map map;
+	std::atomic<size_t> failures(0);
+	std::vector<std::thread> workers;
+	for(size_t t = 0; t < threads; t++) {
+		workers.emplace_back([&, t] {
+			std::default_random_engine generator(t);
+			std::uniform_int_distribution<int> distribution(0, keys - 1);
+			for(size_t i = 0; i < operations; i++) {
+				int key = distribution(generator);
+				if(t == 0 && i % 3 == 0)
+					map.erase(key);
+				else if(t == 0)
+					map.insert_or_assign(key, valueFor(key, i));
+				else
+					map.visit(key, [&](const std::string &value) {
+						if(!isValueOf(value, key))
+							failures++;
+					});
+			}
+		});
+	}
+	for(auto &&worker: workers)
+		worker.join();
+	size_t seen = 0;
+	map.for_each([&](const std::pair<const int, std::string> &it) {
+		seen++;
+		if(!isValueOf(it.second, it.first))
+			failures++;
+	});
+	if(seen != map.getSize())
+		failures++;
+	std::cout<<mapName<<" stress with "<<threads<<" threads: "<<(failures == 0 ? "ok" : "FAILED")<<"\n";
+	return failures == 0;
+}
+
+// Every thread does the same number of operations, readPercent of them lookups and the rest writes,
+// so ideal scaling keeps the time constant and multiplies the throughput by the thread count.
+template <typename Map>
+double readScaling(size_t threads, size_t keys, size_t operations, int readPercent, std::string mapName) {
+	Map map;
+	for(size_t key = 0; key < keys; key++)
+		map.insert_or_assign(key, valueFor(key, 0));
+	std::atomic<bool> start(false);
+	std::vector<std::thread> workers;
+	std::vector<size_t> hits(threads * 16);
+	for(size_t t = 0; t < threads; t++) {
+		workers.emplace_back([&, t] {
+			std::default_random_engine generator(t);
+			std::uniform_int_distribution<int> distribution(0, keys - 1);
+			std::uniform_int_distribution<int> percent(0, 99);
+			size_t found = 0;
+			while(!start)
+				std::this_thread::yield();
+			for(size_t i = 0; i < operations; i++) {
+				int key = distribution(generator);
+				if(percent(generator) < readPercent)
+					found += lookUp(map, key);
+				else
+					map.insert_or_assign(key, valueFor(key, i));
+			}
+			hits[t * 16] = found;
+		});
+	}
+	auto begin = std::chrono::steady_clock::now();
+	start = true;
+	for(auto &&worker: workers)
+		worker.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	double throughput = threads * operations / elapsed.count() / 1e6;
+	std::cout<<mapName<<" "<<threads<<" threads, "<<readPercent<<"% reads: "<<throughput<<" Mops/s\n";
+	return throughput;
+}
+
+template <typename Map>
+void testScaling(size_t maxThreads, size_t keys, size_t operations, std::string mapName) {
+	double single = 0;
+	for(size_t threads = 1; threads <= maxThreads; threads *= 2) {
+		double throughput = readScaling<Map>(threads, keys, operations, 99, mapName);
+		if(threads == 1)
+			single = throughput;
+		else
+			std::cout<<mapName<<" speedup at "<<threads<<" threads: "<<throughput / single<<"x\n";
+	}
+}
+
+// Finds every key of a map split into many segments on one thread. The segments must spread their
+// keys over all their buckets whatever the bucket policy, so the time should not depend on it.
+template <typename Map>
+void testSegmentSpread(size_t segments, size_t keys, std::string mapName) {
+	Map map(segments);
+	for(size_t key = 0; key < keys; key++)
+		map.insert_or_assign(key, valueFor(key, 0));
+	auto begin = std::chrono::steady_clock::now();
+	size_t found = 0;
+	for(size_t key = 0; key < keys; key++)
+		found += map.contains(key);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+	if(found != keys)
+		std::cout<<mapName<<" lost keys\n";
+	std::cout<<mapName<<" find time of "<<keys<<" keys in "<<segments<<" segments: "<<std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()<<"\n";
+}
+
+int main(int argc, char **argv)
+{
+	size_t maxThreads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : std::thread::hardware_concurrency();
+	if(maxThreads == 0)
+		maxThreads = 1;
+	const size_t keys = 100000;
+	const size_t operations = 2000000;
+	bool passed = stress<IntConcurrentHashMap>(std::max<size_t>(maxThreads, 4), 1000, 200000, "ConcurrentHashMap");
+	passed = stress<IntPow2ConcurrentHashMap>(std::max<size_t>(maxThreads, 4), 1000, 200000, "Pow2ConcurrentHashMap")
+			&& passed;
+	passed = stress<IntRcuHashMap>(std::max<size_t>(maxThreads, 4), 1000, 200000, "RcuHashMap") && passed;
+	testScaling<LockedHashMap>(maxThreads, keys, operations, "LockedHashMap");
+	testScaling<IntConcurrentHashMap>(maxThreads, keys, operations, "ConcurrentHashMap");
+	testScaling<IntPow2ConcurrentHashMap>(maxThreads, keys, operations, "Pow2ConcurrentHashMap");
+	testScaling<IntRcuHashMap>(maxThreads, keys, operations, "RcuHashMap");
+	testSegmentSpread<IntConcurrentHashMap>(64, 1000000, "ConcurrentHashMap");
+	testSegmentSpread<IntPow2ConcurrentHashMap>(64, 1000000, "Pow2ConcurrentHashMap");
+	return passed ? 0 : 1;
+}
@@ -1,60 +1,113 @@
 #include <cstddef>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <string_view>
+#include <stdexcept>
 #include <random>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <thread>
 
 #include "TreeMap.h"
+#include "BTreeMap.h"
+#include "PersistentTreeMap.h"
 #include "HashMap.h"
+#include "MappedHashMap.h"
+#include "FlatHashMap.h"
+#include "SlabAllocator.h"
 
 using namespace aisdi;
 
-void treeAppend(TreeMap<int, std::string> &tree, int i) {
+using IntTree = TreeMap<int, std::string>;
+using IntSlabTree = TreeMap<int, std::string, SlabAllocator<std::pair<const int, std::string>>>;
+using IntRankedTree = OrderStatisticTreeMap<int, std::string>;
+using IntAvlTree = TreeMap<int, std::string, std::allocator<std::pair<const int, std::string>>, false, std::less<int>,
+		AvlPolicy>;
+using StringTree = TreeMap<std::string, std::string>;
+using ThreeWayStringTree = TreeMap<std::string, std::string, std::allocator<std::pair<const std::string, std::string>>,
+		false, ThreeWayCompare<std::string>>;
+using IntBTree = BTreeMap<int, std::string>;
+using IntPersistentTree = PersistentTreeMap<int, std::string>;
+using IntHashMap = HashMap<int, std::string>;
+using IntSlabHashMap = HashMap<int, std::string, std::hash<int>, std::equal_to<int>,
+		SlabAllocator<std::pair<const int, std::string>>>;
+using IntPow2HashMap = HashMap<int, std::string, IntegerHash<int>, std::equal_to<int>,
+		std::allocator<std::pair<const int, std::string>>, PowerOfTwoPolicy>;
+using IntFastRangeHashMap = HashMap<int, std::string, IntegerHash<int>, std::equal_to<int>,
+		std::allocator<std::pair<const int, std::string>>, FastRangePolicy>;
+using IntFlatHashMap = FlatHashMap<int, std::string>;
+using StringHashMap = HashMap<std::string, std::string, StringHash, std::equal_to<>>;
+using TransparentStringTree = TreeMap<std::string, std::string, std::allocator<std::pair<const std::string, std::string>>,
+		false, std::less<>>;
+
+template <typename Tree>
+void treeAppend(Tree &tree, int i) {
 	tree[i] = "testString";
 }
-void hashMapAppend(HashMap<int, std::string> &hashMap, int i) {
+template <typename Map>
+void hashMapAppend(Map &hashMap, int i) {
 	hashMap[i] = "testString";
 }
-void treeFind(TreeMap<int, std::string> &tree, int i) {
+template <typename Tree>
+void treeFind(Tree &tree, int i) {
 	tree.find(i);
 }
-void hashMapFind(HashMap<int, std::string> &hashMap, int i) {
+template <typename Map>
+void hashMapFind(Map &hashMap, int i) {
 	hashMap.find(i);
 }
-void iterateTree(TreeMap<int, std::string> &tree, int i) {
+template <typename Tree>
+void iterateTree(Tree &tree, int i) {
 	(void) i;
 	for(auto &&it: tree) (void) it;
 }
-void iterateHashMap(HashMap<int, std::string> &hashMap, int i) {
+template <typename Map>
+void iterateHashMap(Map &hashMap, int i) {
 	(void) i;
 	for(auto &&it: hashMap) (void) it;
 }
-TreeMap<int, std::string> createTree(size_t elements)
+template <typename Tree>
+void treePositionByWalk(Tree &tree, int i) {
+	volatile size_t position = 0;
+	for(auto it = tree.begin(), last = tree.lower_bound(i); it != last; ++it)
+		position = position + 1;
+}
+template <typename Tree>
+void treeRank(Tree &tree, int i) {
+	volatile auto position = tree.rank(i);
+	(void) position;
+}
+template <typename Tree>
+Tree createTree(size_t elements)
 {
 	std::random_device rd;
 	std::default_random_engine generator(rd());
 	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
-	TreeMap<int, std::string> tree;
+	Tree tree;
 	for(size_t i = 0; i < elements; i++)
 		tree[distribution(generator)] = "testString";
 	return tree;
 }
-HashMap<int, std::string> createHashMap(size_t elements) {
+template <typename Map>
+Map createHashMap(size_t elements) {
 	std::random_device rd;
 	std::default_random_engine generator(rd());
 	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
-	HashMap<int, std::string> hashMap;
+	Map hashMap;
 	for(size_t i = 0; i < elements; i++)
 		hashMap[distribution(generator)] = "testString";
 	return hashMap;
 }
-void testTree(void (*function)(TreeMap<int, std::string> &tree, int i), double tests, size_t messageData, size_t elements, size_t startElements, std::string name){
+template <typename Tree>
+void testTree(void (*function)(Tree &tree, int i), double tests, size_t messageData, size_t elements, size_t startElements, std::string name, std::string treeName = "Tree"){
 	std::random_device rd;
 	std::default_random_engine generator(rd());
 	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
-	std::chrono::duration<double> treeTime;
+	std::chrono::duration<double> treeTime(0);
 	for(double i = 0; i < tests; i++) {
-		TreeMap<int, std::string> tree = createTree(startElements);
+		Tree tree = createTree<Tree>(startElements);
 		auto startTree = std::chrono::steady_clock::now();
 		for(size_t j = 0; j < elements; j++)
 		{
@@ -64,16 +117,17 @@ void testTree(void (*function)(TreeMap<int, std::string> &tree, int i), double t
 		std::chrono::duration<double> elapsedSecondsTree = endTree-startTree;
 		treeTime += elapsedSecondsTree;
 	}
-	std::cout<<"Tree "<<name<<" time of "<<messageData<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(treeTime).count()/tests<<"\n";
+	std::cout<<treeName<<" "<<name<<" time of "<<messageData<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(treeTime).count()/tests<<"\n";
 }
 
-void testHashMap(void (*function)(HashMap<int, std::string> &hashMap, int i), double tests, size_t messageData, size_t elements, size_t startElements, std::string name){
+template <typename Map>
+void testHashMap(void (*function)(Map &hashMap, int i), double tests, size_t messageData, size_t elements, size_t startElements, std::string name, std::string mapName = "HashMap"){
 	std::random_device rd;
 	std::default_random_engine generator(rd());
 	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
-	std::chrono::duration<double> hashMapTime;
+	std::chrono::duration<double> hashMapTime(0);
 	for(double i = 0; i < tests; i++) {
-		HashMap<int, std::string> hashMap = createHashMap(startElements);
+		Map hashMap = createHashMap<Map>(startElements);
 		auto startHashMap = std::chrono::steady_clock::now();
 		for(size_t j = 0; j < elements; j++)
 		{
@@ -83,23 +137,425 @@ void testHashMap(void (*function)(HashMap<int, std::string> &hashMap, int i), do
 		std::chrono::duration<double> elapsedSecondHashMap = endHashMap-startHashMap;
 		hashMapTime += elapsedSecondHashMap;
 	}
-	std::cout<<"HashMap "<<name<<" time of "<<messageData<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(hashMapTime).count()/tests<<"\n";
+	std::cout<<mapName<<" "<<name<<" time of "<<messageData<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(hashMapTime).count()/tests<<"\n";
+}
+
+// Building a tree from a snapshot: n calls of operator[] against the range constructor.
+template <typename Tree>
+void testBulkLoad(double tests, size_t elements, bool sorted, std::string treeName = "Tree") {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::chrono::duration<double> insertTime(0);
+	std::chrono::duration<double> bulkTime(0);
+	for(double i = 0; i < tests; i++) {
+		std::vector<std::pair<int, std::string>> snapshot;
+		for(size_t j = 0; j < elements; j++)
+			snapshot.emplace_back(distribution(generator), "testString");
+		if(sorted)
+			std::sort(snapshot.begin(), snapshot.end());
+		auto startInsert = std::chrono::steady_clock::now();
+		Tree tree;
+		for(auto &&it: snapshot)
+			tree[it.first] = it.second;
+		auto startBulk = std::chrono::steady_clock::now();
+		Tree bulk(snapshot.begin(), snapshot.end());
+		auto endBulk = std::chrono::steady_clock::now();
+		insertTime += startBulk - startInsert;
+		bulkTime += endBulk - startBulk;
+	}
+	std::string order = sorted ? "sorted" : "unsorted";
+	std::cout<<treeName<<" "<<order<<" operator[] build time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(insertTime).count()/tests<<"\n";
+	std::cout<<treeName<<" "<<order<<" bulk load time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(bulkTime).count()/tests<<"\n";
 }
 
+// A read transaction per write: every snapshot is a copy of the map, kept while the map changes.
+template <typename Tree>
+void testSnapshots(double tests, size_t elements, size_t snapshots, std::string treeName = "Tree") {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::chrono::duration<double> snapshotTime(0);
+	for(double i = 0; i < tests; i++) {
+		Tree tree;
+		for(size_t j = 0; j < elements; j++)
+			tree.insert_or_assign(distribution(generator), "testString");
+		std::vector<Tree> kept;
+		kept.reserve(snapshots);
+		auto start = std::chrono::steady_clock::now();
+		for(size_t j = 0; j < snapshots; j++) {
+			kept.push_back(tree);
+			tree.insert_or_assign(distribution(generator), "testString");
+		}
+		snapshotTime += std::chrono::steady_clock::now() - start;
+	}
+	std::cout<<treeName<<" snapshot and write time of "<<snapshots<<" snapshots of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(snapshotTime).count()/tests<<"\n";
+}
+
+// Folding a second map into a tree: operator[] per element against merge, and splitting it again.
+template <typename Tree>
+void testMerge(double tests, size_t elements, size_t otherElements, std::string treeName = "Tree") {
+	std::chrono::duration<double> insertTime(0);
+	std::chrono::duration<double> mergeTime(0);
+	std::chrono::duration<double> splitTime(0);
+	for(double i = 0; i < tests; i++) {
+		Tree tree = createTree<Tree>(elements);
+		Tree other = createTree<Tree>(otherElements);
+		Tree copy = tree;
+		auto startInsert = std::chrono::steady_clock::now();
+		for(auto &&it: other)
+			copy[it.first] = it.second;
+		auto startMerge = std::chrono::steady_clock::now();
+		tree.merge(other);
+		auto startSplit = std::chrono::steady_clock::now();
+		Tree upper = tree.split(INT32_MAX / 2);
+		auto endSplit = std::chrono::steady_clock::now();
+		insertTime += startMerge - startInsert;
+		mergeTime += startSplit - startMerge;
+		splitTime += endSplit - startSplit;
+	}
+	std::string data = std::to_string(otherElements) + " into " + std::to_string(elements);
+	std::cout<<treeName<<" operator[] of "<<data<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(insertTime).count()/tests<<"\n";
+	std::cout<<treeName<<" merge of "<<data<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(mergeTime).count()/tests<<"\n";
+	std::cout<<treeName<<" split of "<<elements + otherElements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(splitTime).count()/tests<<"\n";
+}
+
+// An ingest stream in almost ascending order, every few keys one from a little earlier.
+template <typename Tree>
+void testNearSorted(double tests, size_t elements, std::string treeName = "Tree") {
+	std::vector<int> keys;
+	for(size_t j = 0; j < elements; j++)
+		keys.push_back(j % 8 == 7 ? j * 4 - 9 : j * 4);
+	std::chrono::duration<double> indexTime(0);
+	std::chrono::duration<double> hintTime(0);
+	for(double i = 0; i < tests; i++) {
+		auto startIndex = std::chrono::steady_clock::now();
+		Tree indexed;
+		for(auto key: keys)
+			indexed[key] = "testString";
+		auto startHint = std::chrono::steady_clock::now();
+		Tree hinted;
+		auto hint = hinted.end();
+		for(auto key: keys)
+			hint = hinted.emplace_hint(hint, key, "testString");
+		auto endHint = std::chrono::steady_clock::now();
+		indexTime += startHint - startIndex;
+		hintTime += endHint - startHint;
+	}
+	std::cout<<treeName<<" near-sorted operator[] time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(indexTime).count()/tests<<"\n";
+	std::cout<<treeName<<" near-sorted emplace_hint time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(hintTime).count()/tests<<"\n";
+}
+
+// Lookups of string keys sharing a long prefix, where every comparison is a memcmp of most of the key.
+template <typename Tree>
+void testStringFind(double tests, size_t elements, std::string treeName = "StringTree") {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::vector<std::string> keys;
+	for(size_t j = 0; j < elements; j++)
+		keys.push_back("tenant/eu-west/customer/" + std::to_string(distribution(generator)));
+	Tree tree;
+	for(auto &&key: keys)
+		tree[key] = "testString";
+	std::chrono::duration<double> findTime(0);
+	for(double i = 0; i < tests; i++) {
+		std::shuffle(keys.begin(), keys.end(), generator);
+		size_t found = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(auto &&key: keys)
+			found += tree.find(key) != tree.end();
+		findTime += std::chrono::steady_clock::now() - start;
+		if(found != keys.size())
+			std::cout<<treeName<<" lost keys\n";
+	}
+	std::cout<<treeName<<" find time of "<<elements<<" string keys: "<<std::chrono::duration_cast<std::chrono::microseconds>(findTime).count()/tests<<"\n";
+}
+
+// Height of a tree filled in ascending key order, where red-black balancing leaves the tree most
+// lopsided, or in random order, and the time to find all of its keys.
+template <typename Tree>
+void testLookup(double tests, size_t elements, bool sorted, std::string treeName = "Tree") {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::vector<int> keys;
+	for(size_t j = 0; j < elements; j++)
+		keys.push_back(sorted ? j : distribution(generator));
+	Tree tree;
+	for(auto key: keys)
+		tree[key] = "testString";
+	std::string order = sorted ? "sorted" : "random";
+	std::cout<<treeName<<" height of "<<elements<<" "<<order<<" elements: "<<tree.getHeight()<<"\n";
+	std::chrono::duration<double> findTime(0);
+	for(double i = 0; i < tests; i++) {
+		std::shuffle(keys.begin(), keys.end(), generator);
+		size_t found = 0;
+		auto start = std::chrono::steady_clock::now();
+		for(auto key: keys)
+			found += tree.find(key) != tree.end();
+		findTime += std::chrono::steady_clock::now() - start;
+		if(found != keys.size())
+			std::cout<<treeName<<" lost keys\n";
+	}
+	std::cout<<treeName<<" find time of "<<elements<<" "<<order<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(findTime).count()/tests<<"\n";
+}
+// Finds the keys of a large map one by one and in batches through find_many. The keys are looked up
+// in random order, so nearly every lookup misses the cache once the map is larger than it.
+template <typename Map>
+void testFindMany(double tests, size_t elements, size_t batch, std::string mapName) {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::vector<int> keys;
+	Map map;
+	while(keys.size() < elements) {
+		auto key = distribution(generator);
+		if(map.find(key) == map.end()) {
+			map[key] = "testString";
+			keys.push_back(key);
+		}
+	}
+	const Map &constMap = map;
+	std::vector<typename Map::const_iterator> found(batch);
+	std::chrono::duration<double> findTime(0);
+	std::chrono::duration<double> batchTime(0);
+	for(double i = 0; i < tests; i++) {
+		std::shuffle(keys.begin(), keys.end(), generator);
+		size_t foundOne = 0, foundMany = 0;
+		auto startFind = std::chrono::steady_clock::now();
+		for(auto key: keys)
+			foundOne += constMap.find(key) != constMap.end();
+		auto startBatch = std::chrono::steady_clock::now();
+		for(size_t j = 0; j < keys.size(); j += batch) {
+			auto last = keys.begin() + std::min(j + batch, keys.size());
+			auto end = constMap.find_many(keys.begin() + j, last, found.begin());
+			for(auto it = found.begin(); it != end; ++it)
+				foundMany += *it != constMap.end();
+		}
+		auto endBatch = std::chrono::steady_clock::now();
+		findTime += startBatch - startFind;
+		batchTime += endBatch - startBatch;
+		if(foundOne != keys.size() || foundMany != keys.size())
+			std::cout<<mapName<<" lost keys\n";
+	}
+	std::cout<<mapName<<" find time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(findTime).count()/tests<<"\n";
+	std::cout<<mapName<<" find_many time of "<<elements<<" elements in batches of "<<batch<<": "<<std::chrono::duration_cast<std::chrono::microseconds>(batchTime).count()/tests<<"\n";
+}
+// Looks up string_views of which missRate percent are missing: through valueOf, which has to build a
+// std::string for every probe and throws on a miss, and through get_if, which does neither.
+template <typename Map>
+void testGetIf(double tests, size_t elements, int missRate, std::string mapName) {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> percent(0, 99);
+	Map map;
+	std::vector<std::string> probes;
+	for(size_t j = 0; j < elements; j++) {
+		auto key = "tenant/eu-west/customer/" + std::to_string(j);
+		if(percent(generator) < missRate)
+			key += "/missing";
+		else
+			map[key] = "testString";
+		probes.push_back(key);
+	}
+	std::chrono::duration<double> valueOfTime(0);
+	std::chrono::duration<double> getIfTime(0);
+	for(double i = 0; i < tests; i++) {
+		size_t foundValueOf = 0, foundGetIf = 0;
+		auto startValueOf = std::chrono::steady_clock::now();
+		for(auto &&probe: probes) {
+			std::string_view key = probe;
+			try {
+				foundValueOf += map.valueOf(std::string(key)).size() > 0;
+			} catch(std::out_of_range &) {
+			}
+		}
+		auto startGetIf = std::chrono::steady_clock::now();
+		for(auto &&probe: probes)
+			foundGetIf += map.get_if(std::string_view(probe)) != nullptr;
+		auto endGetIf = std::chrono::steady_clock::now();
+		valueOfTime += startGetIf - startValueOf;
+		getIfTime += endGetIf - startGetIf;
+		if(foundValueOf != map.getSize() || foundGetIf != map.getSize())
+			std::cout<<mapName<<" lost keys\n";
+	}
+	std::cout<<mapName<<" valueOf time of "<<elements<<" lookups with "<<missRate<<"% misses: "<<std::chrono::duration_cast<std::chrono::microseconds>(valueOfTime).count()/tests<<"\n";
+	std::cout<<mapName<<" get_if time of "<<elements<<" lookups with "<<missRate<<"% misses: "<<std::chrono::duration_cast<std::chrono::microseconds>(getIfTime).count()/tests<<"\n";
+}
+// Builds a map from a vector of pairs through operator[], and through the range constructor on one
+// thread and on every core.
+template <typename Map>
+void testParallelBuild(double tests, size_t elements, std::string mapName = "HashMap") {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::vector<std::pair<int, std::string>> pairs;
+	for(size_t j = 0; j < elements; j++)
+		pairs.emplace_back(distribution(generator), "testString");
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::chrono::duration<double> indexTime(0);
+	std::chrono::duration<double> serialTime(0);
+	std::chrono::duration<double> parallelTime(0);
+	for(double i = 0; i < tests; i++) {
+		auto startIndex = std::chrono::steady_clock::now();
+		{
+			Map map;
+			for(auto &&pair: pairs)
+				map[pair.first] = pair.second;
+		}
+		auto startSerial = std::chrono::steady_clock::now();
+		{
+			Map map(pairs.begin(), pairs.end());
+		}
+		auto startParallel = std::chrono::steady_clock::now();
+		{
+			Map map(pairs.begin(), pairs.end(), cores);
+		}
+		auto endParallel = std::chrono::steady_clock::now();
+		indexTime += startSerial - startIndex;
+		serialTime += startParallel - startSerial;
+		parallelTime += endParallel - startParallel;
+	}
+	std::cout<<mapName<<" operator[] build time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(indexTime).count()/tests<<"\n";
+	std::cout<<mapName<<" range build time of "<<elements<<" elements on 1 thread: "<<std::chrono::duration_cast<std::chrono::microseconds>(serialTime).count()/tests<<"\n";
+	std::cout<<mapName<<" range build time of "<<elements<<" elements on "<<cores<<" threads: "<<std::chrono::duration_cast<std::chrono::microseconds>(parallelTime).count()/tests<<"\n";
+}
+// Sums the keys of a map with a range-for loop, and with parallel_reduce on every core.
+template <typename Map>
+void testParallelScan(double tests, size_t elements, std::string mapName) {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	Map map;
+	for(size_t j = 0; j < elements; j++)
+		map[distribution(generator)] = "testString";
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::chrono::duration<double> loopTime(0);
+	std::chrono::duration<double> reduceTime(0);
+	for(double i = 0; i < tests; i++) {
+		auto startLoop = std::chrono::steady_clock::now();
+		long long loopSum = 0;
+		for(auto &&it: map)
+			loopSum += it.first;
+		auto startReduce = std::chrono::steady_clock::now();
+		auto reduceSum = map.parallel_reduce(0LL,
+				[](long long sum, const typename Map::value_type &it) { return sum + it.first; },
+				[](long long a, long long b) { return a + b; }, cores);
+		auto endReduce = std::chrono::steady_clock::now();
+		loopTime += startReduce - startLoop;
+		reduceTime += endReduce - startReduce;
+		if(loopSum != reduceSum)
+			std::cout<<mapName<<" sums differ\n";
+	}
+	std::cout<<mapName<<" range-for sum time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(loopTime).count()/tests<<"\n";
+	std::cout<<mapName<<" parallel_reduce sum time of "<<elements<<" elements on "<<cores<<" threads: "<<std::chrono::duration_cast<std::chrono::microseconds>(reduceTime).count()/tests<<"\n";
+}
+// Rebuilds a map from its pairs, against saving it once and mapping the image, then finds every key
+// in both.
+void testSnapshot(double tests, size_t elements) {
+	std::random_device rd;
+	std::default_random_engine generator(rd());
+	std::uniform_int_distribution<int> distribution(0, INT32_MAX);
+	std::vector<std::pair<int, long long>> pairs;
+	for(size_t j = 0; j < elements; j++)
+		pairs.emplace_back(distribution(generator), j);
+	const std::string path = "snapshot.bin";
+	HashMap<int, long long> source(pairs.begin(), pairs.end());
+	source.save(path);
+	std::chrono::duration<double> buildTime(0);
+	std::chrono::duration<double> mapTime(0);
+	std::chrono::duration<double> findTime(0);
+	std::chrono::duration<double> mappedFindTime(0);
+	for(double i = 0; i < tests; i++) {
+		auto startBuild = std::chrono::steady_clock::now();
+		HashMap<int, long long> map(pairs.begin(), pairs.end());
+		auto startMap = std::chrono::steady_clock::now();
+		MappedHashMap<int, long long> mapped(path);
+		auto startFind = std::chrono::steady_clock::now();
+		long long sum = 0;
+		for(auto &&pair: pairs)
+			sum += *map.get_if(pair.first);
+		auto startMappedFind = std::chrono::steady_clock::now();
+		long long mappedSum = 0;
+		for(auto &&pair: pairs)
+			mappedSum += *mapped.get_if(pair.first);
+		auto end = std::chrono::steady_clock::now();
+		buildTime += startMap - startBuild;
+		mapTime += startFind - startMap;
+		findTime += startMappedFind - startFind;
+		mappedFindTime += end - startMappedFind;
+		if(sum != mappedSum)
+			std::cout<<"MappedHashMap sums differ\n";
+	}
+	std::remove(path.c_str());
+	std::cout<<"HashMap build time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(buildTime).count()/tests<<"\n";
+	std::cout<<"MappedHashMap load time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(mapTime).count()/tests<<"\n";
+	std::cout<<"HashMap find time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(findTime).count()/tests<<"\n";
+	std::cout<<"MappedHashMap find time of "<<elements<<" elements: "<<std::chrono::duration_cast<std::chrono::microseconds>(mappedFindTime).count()/tests<<"\n";
+}
 int main()
 {
 	const int tests = 2000;
-  testTree(treeAppend, tests, 1000, 1000, 0, "append");
-	testHashMap(hashMapAppend, tests, 1000, 1000, 0, "append");
-	testTree(treeAppend, tests, 10000, 10000, 0, "append");
-	testHashMap(hashMapAppend, tests, 10000, 10000, 0, "append");
-	testTree(treeFind, tests, 1000, 1000, 1000, "find");
-	testHashMap(hashMapFind, tests, 1000, 1000, 1000, "find");
-	testTree(treeFind, tests, 10000, 10000, 10000, "find");
-	testHashMap(hashMapFind, tests, 10000, 10000, 10000, "find");
-	testTree(iterateTree, tests, 1000, 1, 1000, "iterate");
-	testHashMap(iterateHashMap, tests, 1000, 1, 1000, "iterate");
-	testTree(iterateTree, tests, 10000, 1, 10000, "iterate");
-	testHashMap(iterateHashMap, tests, 10000, 1, 10000, "iterate");
+  testTree<IntTree>(treeAppend, tests, 1000, 1000, 0, "append");
+	testTree<IntSlabTree>(treeAppend, tests, 1000, 1000, 0, "append", "SlabTree");
+	testTree<IntBTree>(treeAppend, tests, 1000, 1000, 0, "append", "BTree");
+	testHashMap<IntHashMap>(hashMapAppend, tests, 1000, 1000, 0, "append");
+	testHashMap<IntSlabHashMap>(hashMapAppend, tests, 1000, 1000, 0, "append", "SlabHashMap");
+	testHashMap<IntFlatHashMap>(hashMapAppend, tests, 1000, 1000, 0, "append", "FlatHashMap");
+	testTree<IntTree>(treeAppend, tests, 10000, 10000, 0, "append");
+	testTree<IntAvlTree>(treeAppend, tests, 10000, 10000, 0, "append", "AvlTree");
+	testTree<IntSlabTree>(treeAppend, tests, 10000, 10000, 0, "append", "SlabTree");
+	testTree<IntBTree>(treeAppend, tests, 10000, 10000, 0, "append", "BTree");
+	testTree<IntRankedTree>(treeAppend, tests, 10000, 10000, 0, "append", "RankedTree");
+	testHashMap<IntHashMap>(hashMapAppend, tests, 10000, 10000, 0, "append");
+	testHashMap<IntSlabHashMap>(hashMapAppend, tests, 10000, 10000, 0, "append", "SlabHashMap");
+	testHashMap<IntFlatHashMap>(hashMapAppend, tests, 10000, 10000, 0, "append", "FlatHashMap");
+	testTree<IntTree>(treeFind, tests, 1000, 1000, 1000, "find");
+	testTree<IntAvlTree>(treeFind, tests, 1000, 1000, 1000, "find", "AvlTree");
+	testTree<IntBTree>(treeFind, tests, 1000, 1000, 1000, "find", "BTree");
+	testHashMap<IntHashMap>(hashMapFind, tests, 1000, 1000, 1000, "find");
+	testHashMap<IntFlatHashMap>(hashMapFind, tests, 1000, 1000, 1000, "find", "FlatHashMap");
+	testTree<IntTree>(treeFind, tests, 10000, 10000, 10000, "find");
+	testTree<IntBTree>(treeFind, tests, 10000, 10000, 10000, "find", "BTree");
+	testTree<IntTree>(treeFind, tests / 400, 100000, 100000, 1000000, "find");
+	testTree<IntBTree>(treeFind, tests / 400, 100000, 100000, 1000000, "find", "BTree");
+	testHashMap<IntHashMap>(hashMapFind, tests, 10000, 10000, 10000, "find");
+	testHashMap<IntPow2HashMap>(hashMapFind, tests, 10000, 10000, 10000, "find", "Pow2HashMap");
+	testHashMap<IntFastRangeHashMap>(hashMapFind, tests, 10000, 10000, 10000, "find", "FastRangeHashMap");
+	testHashMap<IntFlatHashMap>(hashMapFind, tests, 10000, 10000, 10000, "find", "FlatHashMap");
+	testTree<IntTree>(iterateTree, tests, 1000, 1, 1000, "iterate");
+	testTree<IntBTree>(iterateTree, tests, 1000, 1, 1000, "iterate", "BTree");
+	testHashMap<IntHashMap>(iterateHashMap, tests, 1000, 1, 1000, "iterate");
+	testHashMap<IntFlatHashMap>(iterateHashMap, tests, 1000, 1, 1000, "iterate", "FlatHashMap");
+	testTree<IntTree>(iterateTree, tests, 10000, 1, 10000, "iterate");
+	testTree<IntBTree>(iterateTree, tests, 10000, 1, 10000, "iterate", "BTree");
+	testHashMap<IntHashMap>(iterateHashMap, tests, 10000, 1, 10000, "iterate");
+	testHashMap<IntFlatHashMap>(iterateHashMap, tests, 10000, 1, 10000, "iterate", "FlatHashMap");
+	testTree<IntTree>(treePositionByWalk, tests / 200, 1000, 1000, 10000, "position by walk");
+	testTree<IntRankedTree>(treeRank, tests / 200, 1000, 1000, 10000, "rank", "RankedTree");
+	testSnapshots<IntTree>(tests / 100, 10000, 100);
+	testSnapshots<IntPersistentTree>(tests / 100, 10000, 100, "PersistentTree");
+	testStringFind<StringTree>(tests / 2, 1000);
+	testStringFind<StringTree>(tests / 10, 10000);
+	testStringFind<ThreeWayStringTree>(tests / 2, 1000, "ThreeWayStringTree");
+	testStringFind<ThreeWayStringTree>(tests / 10, 10000, "ThreeWayStringTree");
+	testNearSorted<IntTree>(tests / 10, 10000);
+	testMerge<IntTree>(tests / 100, 100000, 1000);
+	testMerge<IntTree>(tests / 100, 100000, 100000);
+	testBulkLoad<IntTree>(tests / 100, 100000, true);
+	testBulkLoad<IntTree>(tests / 100, 100000, false);
+	testLookup<IntTree>(tests / 100, 1000000, true);
+	testLookup<IntAvlTree>(tests / 100, 1000000, true, "AvlTree");
+	testLookup<IntTree>(tests / 100, 1000000, false);
+	testLookup<IntAvlTree>(tests / 100, 1000000, false, "AvlTree");
+	testFindMany<IntHashMap>(tests / 400, 4000000, 256, "HashMap");
+	testFindMany<IntTree>(tests / 400, 4000000, 256, "Tree");
+	testGetIf<StringHashMap>(tests / 10, 10000, 30, "StringHashMap");
+	testGetIf<TransparentStringTree>(tests / 10, 10000, 30, "TransparentStringTree");
+	testParallelBuild<IntHashMap>(tests / 400, 2000000);
+	testParallelScan<IntHashMap>(tests / 200, 1000000, "HashMap");
+	testParallelScan<IntTree>(tests / 200, 1000000, "Tree");
+	testSnapshot(tests / 400, 2000000);
   return 0;
 }